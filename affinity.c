@@ -0,0 +1,258 @@
+#include "affinity.h"
+#include "jobs.h"
+
+// NUMA node found by the last pin_node() in this process or an ancestor
+// (-1 = unknown, -2 = none found yet)
+static int chosen_node = -2;
+
+
+// FUNCTION DECLARATIONS
+// fill cpus[] with the allowed CPUs of NUMA node node, siblings adjacent
+static int compact_cpus(int *cpus, const cpu_set_t *allowed, int node);
+// read a sysfs CPU list file into set; return 0 or -1
+static int read_cpulist(const char *path, cpu_set_t *set);
+
+
+int pin_node(void) {
+    char *policy = getenv("PIPE_AFFINITY");
+    if (policy == NULL || strcmp(policy, "compact") != 0) {
+        return -1;
+    }
+    // stages starting pipelines of their own keep the shell's choice
+    if (chosen_node != -2 && !job_shell()) {
+        return chosen_node;
+    }
+
+    chosen_node = -1;
+    int here = sched_getcpu();
+    if (here < 0) {
+        return chosen_node;
+    }
+    cpu_set_t node;
+    char path[PATH_MAX];
+    for (int i = 0; i < 1024; i++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", i);
+        if (read_cpulist(path, &node) < 0) {
+            if (errno == ENOENT && i > 0) {
+                break;
+            }
+            continue;
+        }
+        if (CPU_ISSET(here, &node)) {
+            chosen_node = i;
+            break;
+        }
+    }
+    return chosen_node;
+}
+
+
+int pin_stage(int stage, int node) {
+    char *policy = getenv("PIPE_AFFINITY");
+    if (policy == NULL || *policy == '\0') {
+        return 0;
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        int errno2 = errno;
+        perror("sched_getaffinity() error");
+        return errno2;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (strcmp(policy, "compact") == 0 || strcmp(policy, "roundrobin") == 0) {
+        int cpus[CPU_SETSIZE];
+        int n = 0;
+
+        if (strcmp(policy, "compact") == 0) {
+            n = compact_cpus(cpus, &allowed, node);
+        }
+        // round robin, or no topology information
+        if (n == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    cpus[n++] = cpu;
+                }
+            }
+        }
+        if (n == 0) {
+            return 0;
+        }
+        CPU_SET(cpus[stage % n], &set);
+    }
+    else {
+        // explicit lists: "0,1:2:3-4"; pick list number stage mod #lists
+        int nLists = 1;
+        for (char *s = policy; *s; s++) {
+            if (*s == ':') {
+                nLists++;
+            }
+        }
+        char *list = policy;
+        for (int i = stage % nLists; i > 0; i--) {
+            list = strchr(list, ':') + 1;
+        }
+        char *copy = strndup(list, strcspn(list, ":"));
+        int p = parse_cpulist(copy, &set);
+        free(copy);
+        if (p < 0) {
+            fprintf(stderr, "PIPE_AFFINITY: bad CPU list: %s\n", policy);
+            return EINVAL;
+        }
+    }
+
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        int errno2 = errno;
+        perror("sched_setaffinity() error");
+        return errno2;
+    }
+    return 0;
+}
+
+
+static int compact_cpus(int *cpus, const cpu_set_t *allowed, int node_id) {
+    if (node_id < 0) {
+        return 0;
+    }
+    cpu_set_t node;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node_id);
+    if (read_cpulist(path, &node) < 0) {
+        return 0;
+    }
+
+    // list each core followed by its hyperthread siblings
+    cpu_set_t taken;
+    CPU_ZERO(&taken);
+    int n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &node) || !CPU_ISSET(cpu, allowed) || CPU_ISSET(cpu, &taken)) {
+            continue;
+        }
+
+        cpu_set_t siblings;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        if (read_cpulist(path, &siblings) < 0) {
+            CPU_ZERO(&siblings);
+            CPU_SET(cpu, &siblings);
+        }
+        for (int sib = cpu; sib < CPU_SETSIZE; sib++) {
+            if (CPU_ISSET(sib, &siblings) && CPU_ISSET(sib, allowed) && !CPU_ISSET(sib, &taken)) {
+                CPU_SET(sib, &taken);
+                cpus[n++] = sib;
+            }
+        }
+    }
+    return n;
+}
+
+
+static int read_cpulist(const char *path, cpu_set_t *set) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char buf[4096];
+    char *s = fgets(buf, sizeof(buf), f);
+    fclose(f);
+    if (s == NULL) {
+        return -1;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    return parse_cpulist(buf, set);
+}
+
+
+int parse_cpulist(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    if (*s == '\0') {
+        return -1;
+    }
+
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10);
+        if (end == s || lo < 0 || lo >= CPU_SETSIZE) {
+            return -1;
+        }
+        long hi = lo;
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo || hi >= CPU_SETSIZE) {
+                return -1;
+            }
+            s = end;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*s == ',') {
+            s++;
+        }
+        else if (*s != '\0') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+int count_stages(const CMD *cmdList) {
+    int n = 1;
+    while (cmdList->type == PIPE) {
+        n++;
+        cmdList = cmdList->left;
+    }
+    return n;
+}
+
+
+int taskset_command(const CMD *cmdList) {
+    // skip "taskset" and an optional "-c"
+    int first = 1;
+    if (cmdList->argc > 1 && strcmp(cmdList->argv[1], "-c") == 0) {
+        first = 2;
+    }
+    if (cmdList->argc < first + 2) {
+        fprintf(stderr, "usage: taskset [-c] CPULIST command [arg]...\n");
+        return 1;
+    }
+
+    cpu_set_t set;
+    if (parse_cpulist(cmdList->argv[first], &set) < 0) {
+        fprintf(stderr, "taskset: bad CPU list: %s\n", cmdList->argv[first]);
+        return 1;
+    }
+
+    // the command inherits the shell's mask at fork, so pin the shell
+    // around it and restore the original mask afterwards
+    cpu_set_t saved;
+    if (sched_getaffinity(0, sizeof(saved), &saved) < 0) {
+        int errno2 = errno;
+        perror("sched_getaffinity() error");
+        return errno2;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        int errno2 = errno;
+        perror("sched_setaffinity() error");
+        return errno2;
+    }
+
+    // the arguments are already expanded, so the copy is run as is rather
+    // than through process(), which would expand them again
+    CMD sub = *cmdList;
+    sub.argv = cmdList->argv + first + 1;
+    sub.argc = cmdList->argc - first - 1;
+    int ret_val = simple_command(&sub);
+
+    if (sched_setaffinity(0, sizeof(saved), &saved) < 0) {
+        int errno2 = errno;
+        perror("sched_setaffinity() error");
+        return errno2;
+    }
+    return ret_val;
+}
@@ -0,0 +1,36 @@
+// affinity.h
+//
+// CPU placement of pipeline stages.  If PIPE_AFFINITY is set, each stage
+// forked by pipe_command() pins itself before it runs:
+//
+//   PIPE_AFFINITY=compact      Stages fill the NUMA node the shell is running
+//                              on when it starts the pipeline, hyperthread
+//                              siblings first, so adjacent stages share
+//                              caches and never cross sockets
+//   PIPE_AFFINITY=roundrobin   Stage i runs on the i-th allowed CPU
+//   PIPE_AFFINITY=0,1:2:4-7    Explicit CPU list per stage, separated by
+//                              colons; stage i uses list i (mod #lists)
+//
+// Stages beyond the number of CPUs (or lists) wrap around.
+
+#include "process.h"
+#include <sched.h>
+
+// Return the NUMA node of the CPU the caller is running on if PIPE_AFFINITY
+// is compact, else -1; call it before forking a pipeline's stages.  A stage
+// that starts a pipeline of its own gets the node the shell found.
+int pin_node (void);
+
+// Pin the calling process according to PIPE_AFFINITY for pipeline stage
+// STAGE (0 = leftmost), using NODE from pin_node(); return 0 or errno
+int pin_stage (int stage, int node);
+
+// Return the number of stages in the pipeline rooted at CMDLIST
+int count_stages (const CMD *cmdList);
+
+// Parse CPU list S (e.g. "0-3,8") into SET; return 0 or -1 if malformed
+int parse_cpulist (const char *s, cpu_set_t *set);
+
+// Built-in "taskset CPULIST command [arg]..." (or "taskset -c CPULIST ...")
+// runs command pinned to CPULIST and returns its status
+int taskset_command (const CMD *cmdList);
@@ -0,0 +1,101 @@
+// affinitybench [SHELL [MB]]
+//
+// Pipeline throughput with and without PIPE_AFFINITY (see affinity.h).
+// SHELL (default ./Bash) runs "head -c MB /dev/zero | cat | cat | cat >
+// /dev/null" (default 512 MB) three times under each placement, and the
+// best time of each is reported in MB/s.
+#include "process.h"
+#include <fcntl.h>
+#include <time.h>
+
+#define RUNS 3
+
+
+// FUNCTION DECLARATIONS
+// return the monotonic clock in seconds
+static double now(void);
+// run TEXT through SHELL with PIPE_AFFINITY set to POLICY (unset if NULL);
+// return the wall time in seconds, or -1 on error
+static double run_shell(const char *shell, const char *policy, const char *text);
+
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+static double run_shell(const char *shell, const char *policy, const char *text) {
+    int fd[2];
+    if (pipe(fd) < 0) {
+        perror("pipe() error");
+        return -1;
+    }
+
+    double start = now();
+    int pid = fork();
+    if (pid < 0) {
+        perror("Fork failure");
+        return -1;
+    }
+    if (pid == 0) {
+        if (policy != NULL) {
+            setenv("PIPE_AFFINITY", policy, 1);
+        }
+        else {
+            unsetenv("PIPE_AFFINITY");
+        }
+        // the shell's prompts go to stdout
+        int null = open("/dev/null", O_WRONLY);
+        dup2(fd[0], STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        close(null);
+        execl(shell, shell, (char *) NULL);
+        perror(shell);
+        _exit(127);
+    }
+
+    close(fd[0]);
+    if (write(fd[1], text, strlen(text)) < 0) {
+        perror("write() error");
+    }
+    close(fd[1]);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    double t = now() - start;
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? t : -1;
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *shell = (argc > 1) ? argv[1] : "./Bash";
+    long mb = (argc > 2) ? atol(argv[2]) : 512;
+    const char *policies[] = {NULL, "compact", "roundrobin"};
+
+    char text[256];
+    snprintf(text, sizeof(text),
+             "head -c %ld /dev/zero | cat | cat | cat > /dev/null\n", mb << 20);
+
+    printf("%ld MB through 4 stages on %ld CPUs, best of %d\n",
+           mb, sysconf(_SC_NPROCESSORS_ONLN), RUNS);
+    for (unsigned p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        double best = -1;
+        for (int i = 0; i < RUNS; i++) {
+            double t = run_shell(shell, policies[p], text);
+            if (t < 0) {
+                fprintf(stderr, "affinitybench: %s failed\n", shell);
+                return 1;
+            }
+            if (best < 0 || t < best) {
+                best = t;
+            }
+        }
+        printf("  PIPE_AFFINITY=%-10s %8.1f MB/s  (%.3f s)\n",
+               policies[p] ? policies[p] : "(unset)", mb / best, best);
+    }
+    return 0;
+}
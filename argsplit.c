@@ -0,0 +1,254 @@
+#include "argsplit.h"
+#include "shellstat.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include "jobs.h"
+#include "expand.h"
+
+
+// FUNCTION DECLARATIONS
+// bytes an argument or environment string takes in execve()
+static long arg_size(const char *s);
+// bytes left for arguments once environment and locals are counted
+static long arg_space(const CMD *cmdList, long limit);
+// start one batch in a child, applying the n descriptor redirections r after
+// its < and >; return pid or -1
+static int start_batch(const CMD *batch, const FdRedir *r, int n);
+// wait for one of the n batches pids[] (with pidfds[], -1 if none) of
+// cmdList to finish or stop, storing its status in *status; return its
+// index or -1
+static int wait_batch(const CMD *cmdList, const int *pids, const int *pidfds, int n, int *status);
+
+
+static long arg_size(const char *s) {
+    return strlen(s) + 1 + sizeof(char *);
+}
+
+
+static long arg_space(const CMD *cmdList, long limit) {
+    if (limit <= 0) {
+        // leave headroom for the auxiliary vector and stack alignment
+        limit = sysconf(_SC_ARG_MAX) - 4096;
+    }
+    for (char **e = environ; *e; e++) {
+        limit -= arg_size(*e);
+    }
+    for (int i = 0; i < cmdList->nLocal; i++) {
+        limit -= strlen(cmdList->locVar[i]) + strlen(cmdList->locVal[i]) + 2 + sizeof(char *);
+    }
+    return limit - sizeof(char *);
+}
+
+
+bool argsplit_needed(const CMD *cmdList) {
+    if (getenv("ARGSPLIT") == NULL) {
+        return false;
+    }
+    long space = arg_space(cmdList, 0);
+    for (int i = 0; i < cmdList->argc && space >= 0; i++) {
+        space -= arg_size(cmdList->argv[i]);
+    }
+    return space < 0;
+}
+
+
+int argsplit_command(const CMD *cmdList) {
+    int keep = 0;
+    int parallel = 1;
+    long limit = 0;
+
+    int i = 1;
+    for ( ; i + 1 < cmdList->argc && cmdList->argv[i][0] == '-'; i += 2) {
+        if (strcmp(cmdList->argv[i], "-k") == 0) {
+            keep = atoi(cmdList->argv[i+1]);
+        }
+        else if (strcmp(cmdList->argv[i], "-P") == 0) {
+            parallel = atoi(cmdList->argv[i+1]);
+        }
+        else if (strcmp(cmdList->argv[i], "-s") == 0) {
+            limit = atol(cmdList->argv[i+1]);
+        }
+        else {
+            break;
+        }
+    }
+    if (i >= cmdList->argc || keep < 0 || parallel < 1) {
+        fprintf(stderr, "usage: argsplit [-k N] [-P N] [-s BYTES] command [arg]...\n");
+        return 1;
+    }
+
+    // the copy keeps N>FILE etc. (see fdRedirs())
+    CMD sub = *cmdList;
+    sub.argv = cmdList->argv + i;
+    sub.argc = cmdList->argc - i;
+    return argsplit_run(&sub, keep, parallel, limit);
+}
+
+
+int argsplit_run(const CMD *cmdList, int keep, int parallel, long limit) {
+    if (keep > cmdList->argc - 1) {
+        keep = cmdList->argc - 1;
+    }
+
+    // the command and kept arguments go in every batch
+    long space = arg_space(cmdList, limit);
+    for (int i = 0; i <= keep; i++) {
+        space -= arg_size(cmdList->argv[i]);
+    }
+
+    // truncate once; every batch appends
+    CMD batch = *cmdList;
+    if (cmdList->toType == RED_OUT) {
+        int fd = open(cmdList->toFile, O_RDWR|O_CREAT|O_TRUNC, S_IRWXU);
+        if (fd < 0) {
+            int errno2 = errno;
+            perror("Open error");
+            return errno2;
+        }
+        stat_add(ST_REDIRS, 1);
+        close(fd);
+        batch.toType = RED_OUT_APP;
+    }
+
+    // each batch applies N>FILE etc. itself, after < and >
+    int nRedir;
+    const FdRedir *redirs = fdRedirs(cmdList, &nRedir);
+
+    char **argv = malloc((cmdList->argc + 1) * sizeof(char *));
+    memcpy(argv, cmdList->argv, (keep + 1) * sizeof(char *));
+    batch.argv = argv;
+
+    // pids[], pidfds[], and first[] of running batches, for the combined
+    // status; only these are waited for, not the shell's other children
+    int *pids = malloc(parallel * sizeof(int));
+    int *pidfds = malloc(parallel * sizeof(int));
+    int *first = malloc(parallel * sizeof(int));
+    int running = 0;
+    int ret_val = 0;
+    int ret_first = cmdList->argc;
+
+    // no batch is started once the job has stopped or its deadline expired
+    int next = keep + 1;
+    while (next < cmdList->argc || running > 0) {
+        if (next < cmdList->argc && running < parallel && !job_suspended() && !job_expired()) {
+            // fill a batch, always taking at least one argument
+            int n = keep + 1;
+            long left = space;
+            int start = next;
+            do {
+                left -= arg_size(cmdList->argv[next]);
+                argv[n++] = cmdList->argv[next++];
+            } while (next < cmdList->argc && left - arg_size(cmdList->argv[next]) >= 0);
+            argv[n] = NULL;
+            batch.argc = n;
+
+            int pid = start_batch(&batch, redirs, nRedir);
+            if (pid < 0) {
+                ret_val = ret_val ? ret_val : 1;
+                break;
+            }
+            pids[running] = pid;
+            pidfds[running] = (parallel > 1) ? syscall(SYS_pidfd_open, pid, 0) : -1;
+            first[running] = start;
+            running++;
+            continue;
+        }
+
+        // wait for a batch to finish
+        int status;
+        int j = wait_batch(cmdList, pids, pidfds, running, &status);
+        if (j < 0) {
+            break;
+        }
+        // keep the status of the earliest failing batch
+        if (STATUS(status) != 0 && first[j] < ret_first) {
+            ret_val = STATUS(status);
+            ret_first = first[j];
+        }
+        if (pidfds[j] >= 0) {
+            close(pidfds[j]);
+        }
+        pids[j] = pids[running-1];
+        pidfds[j] = pidfds[running-1];
+        first[j] = first[running-1];
+        running--;
+    }
+    for (int j = 0; j < running; j++) {
+        if (pidfds[j] >= 0) {
+            close(pidfds[j]);
+        }
+    }
+
+    job_done();
+
+    free(pids);
+    free(pidfds);
+    free(first);
+    free(argv);
+    return ret_val;
+}
+
+
+static int start_batch(const CMD *batch, const FdRedir *r, int n) {
+    // every batch joins the process group of the first, so job control
+    // and a deadline (see timeout.h) apply to all of them as one job
+    int pid = job_fork(true);
+    if (pid < 0) {
+        perror("Fork failure");
+        return -1;
+    }
+
+    if (pid == 0) {
+        for (int i = 0; i < batch->nLocal; i++) {
+            setenv(batch->locVar[i], batch->locVal[i], 1);
+        }
+        redirect_stdin(batch);
+        redirect_stdout(batch);
+        int z = (n > 0) ? fd_apply(r, n, NULL) : 0;
+        if (z != 0) {
+            exit(z);
+        }
+        stat_add(ST_EXECS, 1);
+        execvp(batch->argv[0], batch->argv);
+        int errno2 = errno;
+        stat_add(ST_EXEC_FAILS, 1);
+        perror("execvp() error");
+        exit(errno2);
+    }
+    return pid;
+}
+
+
+static int wait_batch(const CMD *cmdList, const int *pids, const int *pidfds, int n, int *status) {
+    // a pidfd becomes readable when its process exits, but not when it
+    // stops, and only job_wait() enforces a deadline; in those cases the
+    // batches are waited for in order
+    struct pollfd fds[n];
+    bool polled = (n > 1) && !job_suspended() && !job_limited();
+    for (int j = 0; j < n; j++) {
+        fds[j] = (struct pollfd) {pidfds[j], POLLIN, 0};
+        polled = polled && pidfds[j] >= 0;
+    }
+    int ready = 0;
+    while (polled) {
+        int r = poll(fds, n, -1);
+        if (r > 0) {
+            while (ready < n && fds[ready].revents == 0) {
+                ready++;
+            }
+            break;
+        }
+        if (errno != EINTR) {
+            break;
+        }
+    }
+    if (ready == n) {
+        ready = 0;
+    }
+
+    if (job_wait(pids[ready], status, NULL, cmdList) < 0) {
+        return -1;
+    }
+    return ready;
+}
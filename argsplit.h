@@ -0,0 +1,30 @@
+// argsplit.h
+//
+// Splitting of argument lists too long for execve(), without xargs.
+//
+//   argsplit [-k N] [-P N] [-s BYTES] command [arg]...
+//
+// runs COMMAND with the first N (default 0) ARGs in every invocation and
+// the rest divided into as few batches as fit within the kernel's limit on
+// argv plus environment (or BYTES, if given), one batch at a time or up to
+// P at once.  Output redirected with > is truncated once, before the first
+// batch.  The status is 0 if every batch succeeded, otherwise that of the
+// first batch that failed.  The batches are one job (see jobs.h), in one
+// process group, so a stop or a deadline (see timeout.h) applies to all of
+// them, and no further batch is started after either.
+//
+// If ARGSPLIT is set, every simple command whose arguments would not fit
+// is split the same way, keeping the first $ARGSPLIT arguments.
+
+#include "process.h"
+
+// Built-in argsplit; return status
+int argsplit_command (const CMD *cmdList);
+
+// Return true if ARGSPLIT is set and CMDLIST's arguments are too long
+bool argsplit_needed (const CMD *cmdList);
+
+// Run CMDLIST in batches, keeping the first KEEP arguments (after argv[0])
+// in each, with at most PARALLEL at once and LIMIT bytes (0 = the kernel's
+// limit) per invocation; return status
+int argsplit_run (const CMD *cmdList, int keep, int parallel, long limit);
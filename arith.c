@@ -0,0 +1,483 @@
+#include "arith.h"
+#include <ctype.h>
+
+
+// deepest nesting of variables whose values are expressions
+#define MAX_DEPTH 32
+
+
+// state of one evaluation
+typedef struct arith {
+    const char *s;      // expression
+    int pos;            // next character
+    int skip;           // > 0 inside an operand that is not evaluated
+    int depth;          // nesting of variables whose values are expressions
+    const char *err;    // first error, or NULL
+} Arith;
+
+
+// FUNCTION DECLARATIONS
+// evaluate S at nesting DEPTH, storing its value in *value; return 0 or -1
+static int eval_at(const char *s, int depth, long long *value);
+// skip blanks and return the next character
+static char peek(Arith *a);
+// consume operator op if it is next and not followed by a byte in not
+static bool accept(Arith *a, const char *op, const char *not);
+// record error msg (the first one wins)
+static void fail(Arith *a, const char *msg);
+// read an identifier into name[]; return its length (0 = none)
+static int read_name(Arith *a, char *name, int size);
+// return the value of variable name
+static long long get_var(Arith *a, const char *name);
+// set variable name to v unless skipping
+static void set_var(Arith *a, const char *name, long long v);
+// apply binary operator op to l and r
+static long long apply(Arith *a, const char *op, long long l, long long r);
+// one function per precedence level, lowest first
+static long long comma(Arith *a);
+static long long assign(Arith *a);
+static long long ternary(Arith *a);
+static long long logical_or(Arith *a);
+static long long logical_and(Arith *a);
+static long long bit_or(Arith *a);
+static long long bit_xor(Arith *a);
+static long long bit_and(Arith *a);
+static long long equality(Arith *a);
+static long long relation(Arith *a);
+static long long shift(Arith *a);
+static long long additive(Arith *a);
+static long long multiplicative(Arith *a);
+static long long power(Arith *a);
+static long long unary(Arith *a);
+static long long primary(Arith *a);
+
+
+int arith_eval(const char *expr, long long *value) {
+    return eval_at(expr, 0, value);
+}
+
+
+static int eval_at(const char *s, int depth, long long *value) {
+    Arith a = {s, 0, 0, depth, NULL};
+    long long v = comma(&a);
+    if (a.err == NULL && peek(&a) != '\0') {
+        fail(&a, "syntax error");
+    }
+    if (a.err != NULL) {
+        fprintf(stderr, "arithmetic: %s: %s\n", s, a.err);
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+
+static char peek(Arith *a) {
+    while (isspace((unsigned char) a->s[a->pos])) {
+        a->pos++;
+    }
+    return a->s[a->pos];
+}
+
+
+static bool accept(Arith *a, const char *op, const char *not) {
+    peek(a);
+    size_t n = strlen(op);
+    if (strncmp(a->s + a->pos, op, n) != 0) {
+        return false;
+    }
+    char next = a->s[a->pos + n];
+    if (next != '\0' && strchr(not, next)) {
+        return false;
+    }
+    a->pos += n;
+    return true;
+}
+
+
+static void fail(Arith *a, const char *msg) {
+    if (a->err == NULL) {
+        a->err = msg;
+    }
+}
+
+
+static int read_name(Arith *a, char *name, int size) {
+    peek(a);
+    const char *s = a->s + a->pos;
+    int n = 0;
+    if (!isalpha((unsigned char) s[0]) && s[0] != '_') {
+        return 0;
+    }
+    while (isalnum((unsigned char) s[n]) || s[n] == '_') {
+        n++;
+    }
+    if (n >= size) {
+        fail(a, "name too long");
+        return 0;
+    }
+    memcpy(name, s, n);
+    name[n] = '\0';
+    a->pos += n;
+    return n;
+}
+
+
+static long long get_var(Arith *a, const char *name) {
+    const char *v = getenv(name);
+    if (v == NULL || *v == '\0') {
+        return 0;
+    }
+
+    char *end;
+    errno = 0;
+    long long n = strtoll(v, &end, 0);
+    if (errno == 0 && end != v && *end == '\0') {
+        return n;
+    }
+
+    // not a number: evaluate as an expression
+    if (a->depth >= MAX_DEPTH) {
+        fail(a, "expression recursion level exceeded");
+        return 0;
+    }
+    if (eval_at(v, a->depth + 1, &n) < 0) {
+        fail(a, "bad variable value");
+        return 0;
+    }
+    return n;
+}
+
+
+static void set_var(Arith *a, const char *name, long long v) {
+    if (a->skip > 0 || a->err != NULL) {
+        return;
+    }
+    char value[24];
+    sprintf(value, "%lld", v);
+    setenv(name, value, 1);
+}
+
+
+static long long apply(Arith *a, const char *op, long long l, long long r) {
+    // wrap on overflow rather than invoke undefined behavior
+    unsigned long long ul = l, ur = r;
+    switch (op[0]) {
+        case '+':
+            return (long long) (ul + ur);
+        case '-':
+            return (long long) (ul - ur);
+        case '*':
+            return (long long) (ul * ur);
+        case '/':
+        case '%':
+            if (r == 0) {
+                if (a->skip == 0) {
+                    fail(a, "division by 0");
+                }
+                return 0;
+            }
+            if (r == -1) {
+                return (op[0] == '/') ? (long long) (0 - ul) : 0;
+            }
+            return (op[0] == '/') ? l / r : l % r;
+        case '<':
+            return (long long) (ul << (r & 63));
+        case '>':
+            return l >> (r & 63);
+        case '&':
+            return l & r;
+        case '^':
+            return l ^ r;
+        case '|':
+            return l | r;
+        default:
+            return r;
+    }
+}
+
+
+static long long comma(Arith *a) {
+    long long v = assign(a);
+    while (a->err == NULL && accept(a, ",", "")) {
+        v = assign(a);
+    }
+    return v;
+}
+
+
+static long long assign(Arith *a) {
+    // NAME OP= expr, where OP= is not ==
+    static const char *ops[] = {"<<=", ">>=", "*=", "/=", "%=", "+=", "-=",
+                                "&=", "^=", "|=", "=", NULL};
+    int start = a->pos;
+    char name[256];
+    if (read_name(a, name, sizeof(name)) > 0) {
+        for (int i = 0; ops[i]; i++) {
+            if (accept(a, ops[i], "=")) {
+                long long r = assign(a);
+                long long v = (ops[i][0] == '=') ? r
+                            : apply(a, ops[i], get_var(a, name), r);
+                set_var(a, name, v);
+                return v;
+            }
+        }
+    }
+    a->pos = start;
+    return ternary(a);
+}
+
+
+static long long ternary(Arith *a) {
+    long long c = logical_or(a);
+    if (!accept(a, "?", "")) {
+        return c;
+    }
+
+    // evaluate only the branch that is taken
+    a->skip += (c == 0);
+    long long t = assign(a);
+    a->skip -= (c == 0);
+    if (!accept(a, ":", "")) {
+        fail(a, "expected `:'");
+        return 0;
+    }
+    a->skip += (c != 0);
+    long long f = assign(a);
+    a->skip -= (c != 0);
+    return c ? t : f;
+}
+
+
+static long long logical_or(Arith *a) {
+    long long l = logical_and(a);
+    while (a->err == NULL && accept(a, "||", "")) {
+        a->skip += (l != 0);
+        long long r = logical_and(a);
+        a->skip -= (l != 0);
+        l = (l != 0 || r != 0);
+    }
+    return l;
+}
+
+
+static long long logical_and(Arith *a) {
+    long long l = bit_or(a);
+    while (a->err == NULL && accept(a, "&&", "")) {
+        a->skip += (l == 0);
+        long long r = bit_or(a);
+        a->skip -= (l == 0);
+        l = (l != 0 && r != 0);
+    }
+    return l;
+}
+
+
+static long long bit_or(Arith *a) {
+    long long l = bit_xor(a);
+    while (a->err == NULL && accept(a, "|", "|=")) {
+        l |= bit_xor(a);
+    }
+    return l;
+}
+
+
+static long long bit_xor(Arith *a) {
+    long long l = bit_and(a);
+    while (a->err == NULL && accept(a, "^", "=")) {
+        l ^= bit_and(a);
+    }
+    return l;
+}
+
+
+static long long bit_and(Arith *a) {
+    long long l = equality(a);
+    while (a->err == NULL && accept(a, "&", "&=")) {
+        l &= equality(a);
+    }
+    return l;
+}
+
+
+static long long equality(Arith *a) {
+    long long l = relation(a);
+    while (a->err == NULL) {
+        if (accept(a, "==", "")) {
+            l = (l == relation(a));
+        }
+        else if (accept(a, "!=", "")) {
+            l = (l != relation(a));
+        }
+        else {
+            break;
+        }
+    }
+    return l;
+}
+
+
+static long long relation(Arith *a) {
+    long long l = shift(a);
+    while (a->err == NULL) {
+        if (accept(a, "<=", "")) {
+            l = (l <= shift(a));
+        }
+        else if (accept(a, ">=", "")) {
+            l = (l >= shift(a));
+        }
+        else if (accept(a, "<", "<=")) {
+            l = (l < shift(a));
+        }
+        else if (accept(a, ">", ">=")) {
+            l = (l > shift(a));
+        }
+        else {
+            break;
+        }
+    }
+    return l;
+}
+
+
+static long long shift(Arith *a) {
+    long long l = additive(a);
+    while (a->err == NULL) {
+        if (accept(a, "<<", "=")) {
+            l = apply(a, "<", l, additive(a));
+        }
+        else if (accept(a, ">>", "=")) {
+            l = apply(a, ">", l, additive(a));
+        }
+        else {
+            break;
+        }
+    }
+    return l;
+}
+
+
+static long long additive(Arith *a) {
+    long long l = multiplicative(a);
+    while (a->err == NULL) {
+        if (accept(a, "+", "=")) {
+            l = apply(a, "+", l, multiplicative(a));
+        }
+        else if (accept(a, "-", "=")) {
+            l = apply(a, "-", l, multiplicative(a));
+        }
+        else {
+            break;
+        }
+    }
+    return l;
+}
+
+
+static long long multiplicative(Arith *a) {
+    long long l = power(a);
+    while (a->err == NULL) {
+        if (accept(a, "*", "*=")) {
+            l = apply(a, "*", l, power(a));
+        }
+        else if (accept(a, "/", "=")) {
+            l = apply(a, "/", l, power(a));
+        }
+        else if (accept(a, "%", "=")) {
+            l = apply(a, "%", l, power(a));
+        }
+        else {
+            break;
+        }
+    }
+    return l;
+}
+
+
+static long long power(Arith *a) {
+    long long base = unary(a);
+    if (a->err != NULL || !accept(a, "**", "=")) {
+        return base;
+    }
+    long long e = power(a);
+    if (e < 0) {
+        fail(a, "exponent less than 0");
+        return 0;
+    }
+
+    // square and multiply, wrapping like the other operators
+    unsigned long long result = 1, b = base;
+    for ( ; e > 0; e >>= 1) {
+        if (e & 1) {
+            result *= b;
+        }
+        b *= b;
+    }
+    return (long long) result;
+}
+
+
+static long long unary(Arith *a) {
+    char name[256];
+    if (accept(a, "++", "") || accept(a, "--", "")) {
+        char op = a->s[a->pos - 1];
+        accept(a, "$", "");
+        if (read_name(a, name, sizeof(name)) == 0) {
+            fail(a, "++ or -- needs a variable");
+            return 0;
+        }
+        long long v = apply(a, "+", get_var(a, name), (op == '+') ? 1 : -1);
+        set_var(a, name, v);
+        return v;
+    }
+    if (accept(a, "+", "")) {
+        return unary(a);
+    }
+    if (accept(a, "-", "")) {
+        return (long long) (0 - (unsigned long long) unary(a));
+    }
+    if (accept(a, "!", "")) {
+        return !unary(a);
+    }
+    if (accept(a, "~", "")) {
+        return ~unary(a);
+    }
+    return primary(a);
+}
+
+
+static long long primary(Arith *a) {
+    // a nested $((...)) is just a parenthesized expression
+    accept(a, "$", "");
+    if (accept(a, "(", "")) {
+        long long v = comma(a);
+        if (!accept(a, ")", "")) {
+            fail(a, "expected `)'");
+        }
+        return v;
+    }
+
+    const char *s = a->s + a->pos;
+    if (isdigit((unsigned char) *s)) {
+        char *end;
+        errno = 0;
+        long long v = (long long) strtoull(s, &end, 0);
+        if (errno != 0 || isalnum((unsigned char) *end) || *end == '_') {
+            fail(a, "bad number");
+            return 0;
+        }
+        a->pos += end - s;
+        return v;
+    }
+
+    char name[256];
+    if (read_name(a, name, sizeof(name)) == 0) {
+        fail(a, (*s == '\0') ? "missing operand" : "syntax error");
+        return 0;
+    }
+    long long v = get_var(a, name);
+    if (accept(a, "++", "") || accept(a, "--", "")) {
+        set_var(a, name, apply(a, "+", v, (a->s[a->pos - 1] == '+') ? 1 : -1));
+    }
+    return v;
+}
@@ -0,0 +1,31 @@
+// arith.h
+//
+// Arithmetic expansion.  $((expr)) is replaced by the value of EXPR, which
+// is evaluated in the shell with 64-bit signed integers (overflow wraps)
+// using these operators, from highest to lowest precedence:
+//
+//   id++ id--                     Postfix increment and decrement
+//   ++id --id                     Prefix increment and decrement
+//   + - ! ~                       Unary operators
+//   **                            Exponentiation (right associative)
+//   * / %                         Multiplication, division, remainder
+//   + -                           Addition, subtraction
+//   << >>                         Shifts
+//   < <= > >=   == !=             Comparisons (value 1 or 0)
+//   &   ^   |                     Bitwise AND, XOR, OR
+//   &&   ||                       Logical AND, OR (short-circuit)
+//   expr ? expr : expr            Conditional
+//   = *= /= %= += -= <<= >>= &= ^= |=
+//                                 Assignment
+//   expr , expr                   Sequence
+//
+// Numbers are decimal, 0x hexadecimal, or 0 octal.  An identifier (with or
+// without a leading $) names an environment variable; one that is unset or
+// empty is 0, and one whose value is not a number is evaluated as an
+// expression.  Assignment and ++/-- set the variable in the environment.
+
+#include "process.h"
+
+// Evaluate EXPR and store its value in *VALUE; return 0, or -1 after writing
+// a message to stderr
+int arith_eval (const char *expr, long long *value);
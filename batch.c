@@ -0,0 +1,259 @@
+#include "batch.h"
+#include "shellstat.h"
+#include "compile.h"
+#include "expand.h"
+#include "lex.h"
+#include "heredoc.h"
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+
+// one line of the batch
+typedef struct job {
+    char *text;         // line as read (without newline)
+    CMD *cmd;           // parsed command or NULL if it did not parse
+    int status;         // exit status, or -1 if not run
+    double ms;          // wall time in milliseconds
+} Job;
+
+// one running child
+typedef struct slot {
+    int pid;            // 0 if free
+    int job;            // index into jobs[]
+    struct timespec start;
+} Slot;
+
+
+// FUNCTION DECLARATIONS
+// read all of fd into a malloc()-ed, NUL-terminated string; NULL on error
+static char *read_file(int fd, size_t *len);
+// parse all lines of text[0..len) into *jobs; return count
+static int read_jobs(const char *text, size_t len, Job **jobs);
+// milliseconds from a to b
+static double elapsed_ms(const struct timespec *a, const struct timespec *b);
+
+
+int batch(int argc, char *argv[]) {
+    char *file = argv[0];
+    int nJobs = 0;
+    bool keepGoing = false;
+    char *results = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            nJobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-k") == 0) {
+            keepGoing = true;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            results = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: Bash --batch FILE [-j N] [-k] [-o RESULTS]\n");
+            return 2;
+        }
+    }
+    if (nJobs <= 0) {
+        nJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    // FILE is read in one piece and parsed from memory, here documents
+    // included, rather than through the shell's unbuffered stdin
+    int fd = open(file, O_RDONLY|O_CLOEXEC);
+    size_t len;
+    char *text = (fd < 0) ? NULL : read_file(fd, &len);
+    if (text == NULL) {
+        int errno2 = errno;
+        perror(file);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return errno2;
+    }
+    close(fd);
+
+    Job *jobs;
+    int n = read_jobs(text, len, &jobs);
+    free(text);
+
+    // commands read nothing
+    fd = open("/dev/null", O_RDONLY);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+
+    // run with at most nJobs children at once
+    Slot *slots = calloc(nJobs, sizeof(Slot));
+    int running = 0;
+    int next = 0;
+    bool failed = false;
+    while (running > 0 || (next < n && (keepGoing || !failed))) {
+        // start jobs while there is room
+        while (running < nJobs && next < n && (keepGoing || !failed)) {
+            Job *j = &jobs[next];
+            if (j->cmd == NULL) {
+                failed = true;
+                next++;
+                continue;
+            }
+
+            int s = 0;
+            while (slots[s].pid != 0) {
+                s++;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &slots[s].start);
+
+            stat_add(ST_FORKS, 1);
+            int pid = fork();
+            if (pid < 0) {
+                perror("Fork failure");
+                break;
+            }
+            if (pid == 0) {
+                free(slots);
+                Program *prog = compile(j->cmd);
+                exit(execute(prog));
+            }
+            slots[s].pid = pid;
+            slots[s].job = next++;
+            running++;
+        }
+
+        // collect one child
+        int status;
+        int pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        for (int s = 0; s < nJobs; s++) {
+            if (slots[s].pid == pid) {
+                Job *j = &jobs[slots[s].job];
+                j->status = STATUS(status);
+                j->ms = elapsed_ms(&slots[s].start, &end);
+                failed = failed || j->status != 0;
+                slots[s].pid = 0;
+                running--;
+                break;
+            }
+        }
+    }
+    free(slots);
+
+    // report in input order
+    char *path = results;
+    if (path == NULL && asprintf(&path, "%s.results", file) < 0) {
+        path = NULL;
+    }
+    FILE *out = path ? fopen(path, "w") : NULL;
+    if (out == NULL) {
+        perror(path ? path : "asprintf() error");
+        out = stderr;
+    }
+
+    int ret_val = 0;
+    for (int i = 0; i < n; i++) {
+        Job *j = &jobs[i];
+        if (j->cmd == NULL) {
+            fprintf(out, "%d\tparse\t0\t%s\n", i + 1, j->text);
+        }
+        else if (j->status < 0) {
+            fprintf(out, "%d\tskip\t0\t%s\n", i + 1, j->text);
+        }
+        else {
+            fprintf(out, "%d\t%d\t%.3f\t%s\n", i + 1, j->status, j->ms, j->text);
+        }
+        if (ret_val == 0 && (j->cmd == NULL || j->status > 0)) {
+            ret_val = (j->cmd == NULL) ? 2 : j->status;
+        }
+        free(j->text);
+        freeCMD(j->cmd);
+    }
+    if (out != stderr) {
+        fclose(out);
+    }
+    if (path != results) {
+        free(path);
+    }
+    free(jobs);
+    return ret_val;
+}
+
+
+static char *read_file(int fd, size_t *len) {
+    struct stat st;
+    size_t size = (fstat(fd, &st) == 0 && st.st_size > 0) ? st.st_size + 1 : 4096;
+    char *text = malloc(size);
+    *len = 0;
+    ssize_t n;
+    while ((n = read(fd, text + *len, size - *len - 1)) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            free(text);
+            return NULL;
+        }
+        *len += n;
+        if (*len + 1 == size) {
+            size *= 2;
+            REALLOC(text, size);
+        }
+    }
+    text[*len] = '\0';
+    return text;
+}
+
+
+static int read_jobs(const char *text, size_t len, Job **jobs) {
+    int n = 0;
+    int size = 1024;
+    *jobs = malloc(size * sizeof(Job));
+
+    // here documents come from the text, expanded as they are read
+    const char *next = text;
+    const char *end = text + len;
+    here_source(&next, end, true);
+    while (next < end) {
+        const char *nl = memchr(next, '\n', end - next);
+        size_t lineLen = nl ? nl + 1 - next : end - next;
+        char *line = strndup(next, lineLen);
+        next += lineLen;
+
+        char *shielded = shield(line);
+        token *list = lexList(shielded);
+        free(shielded);
+        // blank or comment line
+        if (list == NULL) {
+            free(line);
+            continue;
+        }
+        CMD *cmd = parse(list);
+        freeLexList(list);
+
+        if (n == size) {
+            size *= 2;
+            REALLOC(*jobs, size);
+        }
+        if (line[lineLen-1] == '\n') {
+            line[lineLen-1] = '\0';
+        }
+        (*jobs)[n].text = line;
+        (*jobs)[n].cmd = cmd;
+        (*jobs)[n].status = -1;
+        (*jobs)[n].ms = 0;
+        n++;
+    }
+    here_source(NULL, NULL, false);
+    return n;
+}
+
+
+static double elapsed_ms(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
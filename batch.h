@@ -0,0 +1,21 @@
+// batch.h
+//
+// Batch mode.  "Bash --batch FILE [-j N] [-k] [-o RESULTS]" parses every
+// command line in FILE up front and then runs them as independent jobs, at
+// most N at a time (default: number of CPUs), each in its own child with
+// stdin redirected from /dev/null.  Here documents are read from FILE.
+//
+// Without -k, no new line is started once one has failed.  A results file
+// (default FILE.results) gets one line per command in input order:
+//
+//   INDEX <tab> STATUS <tab> MILLISECONDS <tab> COMMAND
+//
+// where INDEX counts commands from 1, STATUS is "parse" for a line that did
+// not parse and "skip" for one not run, and COMMAND is the line as read.
+// The exit status is 0 if every command succeeded, otherwise the status of
+// the first one (in input order) that failed.
+
+#include "process.h"
+
+// Run batch mode with ARGV[0] the command file; return exit status
+int batch (int argc, char *argv[]);
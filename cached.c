@@ -0,0 +1,465 @@
+#include "cached.h"
+#include "shellstat.h"
+#include "fdredir.h"
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+// default bound on the total size of the cache
+#define CACHED_MAX_DEFAULT (64L * 1024 * 1024)
+
+// after eviction the cache is at most this fraction of the bound, so that
+// every store does not evict
+#define CACHED_LOW_WATER 0.9
+
+#define CACHED_MAGIC "bshcach1"
+
+
+// start of each entry; stdout follows
+typedef struct header {
+    char magic[8];
+    int32_t status;
+    int32_t pad;
+    int64_t length;         // bytes of stdout
+} Header;
+
+// 128-bit key, as two independent 64-bit hashes
+typedef struct key {
+    uint64_t a, b;
+} Key;
+
+// one entry seen while evicting
+typedef struct entry {
+    char name[40];
+    off_t size;
+    struct timespec used;
+} Entry;
+
+
+// FUNCTION DECLARATIONS
+// add the n bytes at p to k
+static void hash_bytes(Key *k, const void *p, size_t n);
+// add string s (and its terminating NUL) to k
+static void hash_string(Key *k, const char *s);
+// add the identity and modification time of file path to k
+static void hash_file(Key *k, const char *path);
+// add the identity, size, and modification time in st to k
+static void hash_stat(Key *k, const struct stat *st);
+// copy stdin to a memfd, adding its contents to k; return the memfd or -1
+static int read_input(Key *k);
+// look up key k, replaying the entry or running the command at
+// cmdList->argv[first] and storing its output; return status
+static int cache_run(const CMD *cmdList, int first, Key k);
+// run the command at cmdList->argv[first] with the redirections applied
+// to cached; return status
+static int run_command(const CMD *cmdList, int first);
+// return the malloc()-ed cache directory, creating it if needed, or NULL
+static char *cache_dir(void);
+// replay entry fd to stdout; return its status, or -1 if it is not valid
+static int replay(int fd);
+// copy n bytes of fd from offset off to stdout; return 0 or -1
+static int copy_out(int fd, off_t off, off_t n);
+// remove least recently used entries of dir until it fits in the bound
+static void evict(const char *dir);
+// order entries by time of last use, oldest first
+static int by_use(const void *x, const void *y);
+// print the number and total size of entries in the cache
+static int cache_stats(void);
+
+
+static void hash_bytes(Key *k, const void *p, size_t n) {
+    // FNV-1a, and a multiply-xorshift mix with different constants
+    const unsigned char *s = p;
+    for (size_t i = 0; i < n; i++) {
+        k->a = (k->a ^ s[i]) * 0x100000001b3ULL;
+        k->b = (k->b + s[i]) * 0x9e3779b97f4a7c15ULL;
+        k->b ^= k->b >> 29;
+    }
+}
+
+
+static void hash_string(Key *k, const char *s) {
+    hash_bytes(k, s, strlen(s) + 1);
+}
+
+
+static void hash_file(Key *k, const char *path) {
+    struct stat st;
+    hash_string(k, path);
+    if (stat(path, &st) < 0) {
+        hash_string(k, "(missing)");
+        return;
+    }
+    hash_stat(k, &st);
+}
+
+
+static void hash_stat(Key *k, const struct stat *st) {
+    int64_t id[5] = {st->st_dev, st->st_ino, st->st_size,
+                     st->st_mtim.tv_sec, st->st_mtim.tv_nsec};
+    hash_bytes(k, id, sizeof(id));
+}
+
+
+static int read_input(Key *k) {
+    int memfd = memfd_create("cached", MFD_CLOEXEC);
+    int fd = (memfd >= 0) ? fcntl(memfd, F_DUPFD_CLOEXEC, FD_SAVE_MIN) : -1;
+    if (memfd >= 0) {
+        close(memfd);
+    }
+    if (fd < 0) {
+        perror("cached: memfd_create() error");
+        return -1;
+    }
+
+    char buf[65536];
+    for ( ; ; ) {
+        ssize_t r = read(STDIN_FILENO, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r < 0) {
+            perror("cached: read error");
+            close(fd);
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        hash_bytes(k, buf, r);
+        if (write(fd, buf, r) != r) {
+            perror("cached: write error");
+            close(fd);
+            return -1;
+        }
+    }
+    hash_string(k, "(stdin)");
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+
+static int run_command(const CMD *cmdList, int first) {
+    CMD sub = *cmdList;
+    sub.argv = cmdList->argv + first;
+    sub.argc = cmdList->argc - first;
+    sub.nLocal = 0;
+    sub.fromType = NONE;
+    sub.toType = NONE;
+    return simple_command(&sub);
+}
+
+
+static char *cache_dir(void) {
+    char *dir;
+    const char *env = getenv("CACHED_DIR");
+    if (env != NULL && *env) {
+        dir = strdup(env);
+    }
+    else {
+        const char *home = getenv("HOME");
+        if (home == NULL) {
+            return NULL;
+        }
+        // create $HOME/.cache first
+        if (asprintf(&dir, "%s/.cache", home) < 0) {
+            return NULL;
+        }
+        mkdir(dir, 0700);
+        free(dir);
+        if (asprintf(&dir, "%s/.cache/bsh-cached", home) < 0) {
+            return NULL;
+        }
+    }
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        perror("cached: mkdir() error");
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+
+static int copy_out(int fd, off_t off, off_t n) {
+    fflush(stdout);
+    while (n > 0) {
+        ssize_t w = sendfile(STDOUT_FILENO, fd, &off, n);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            // stdout that sendfile() cannot write to
+            char buf[65536];
+            ssize_t r = pread(fd, buf, n < sizeof(buf) ? n : sizeof(buf), off);
+            if (r <= 0 || write(STDOUT_FILENO, buf, r) != r) {
+                return -1;
+            }
+            off += r;
+            n -= r;
+            continue;
+        }
+        if (w <= 0) {
+            return -1;
+        }
+        n -= w;
+    }
+    return 0;
+}
+
+
+static int replay(int fd) {
+    Header h;
+    struct stat st;
+    if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || memcmp(h.magic, CACHED_MAGIC, 8) != 0
+            || fstat(fd, &st) < 0 || st.st_size != (off_t) sizeof(h) + h.length) {
+        return -1;
+    }
+    if (copy_out(fd, sizeof(h), h.length) < 0) {
+        perror("cached: write error");
+        return errno;
+    }
+    return h.status;
+}
+
+
+static int by_use(const void *x, const void *y) {
+    const Entry *p = x;
+    const Entry *q = y;
+    if (p->used.tv_sec != q->used.tv_sec) {
+        return (p->used.tv_sec < q->used.tv_sec) ? -1 : 1;
+    }
+    return (p->used.tv_nsec < q->used.tv_nsec) ? -1 : (p->used.tv_nsec > q->used.tv_nsec);
+}
+
+
+static void evict(const char *dir) {
+    long max = CACHED_MAX_DEFAULT;
+    const char *env = getenv("CACHED_MAX");
+    if (env != NULL && atol(env) > 0) {
+        max = atol(env);
+    }
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+    Entry *entries = NULL;
+    int n = 0, size = 0;
+    long total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        if (strlen(de->d_name) != 32 || fstatat(dirfd(d), de->d_name, &st, 0) < 0) {
+            continue;
+        }
+        if (n == size) {
+            size = size ? 2 * size : 64;
+            REALLOC(entries, size);
+        }
+        strcpy(entries[n].name, de->d_name);
+        entries[n].size = st.st_size;
+        entries[n].used = st.st_mtim;
+        total += st.st_size;
+        n++;
+    }
+
+    if (total > max) {
+        qsort(entries, n, sizeof(Entry), by_use);
+        for (int i = 0; i < n && total > max * CACHED_LOW_WATER; i++) {
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+                stat_add(ST_CACHE_EVICTIONS, 1);
+            }
+        }
+    }
+    closedir(d);
+    free(entries);
+}
+
+
+static int cache_stats(void) {
+    char *dir = cache_dir();
+    if (dir == NULL) {
+        return 1;
+    }
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        perror("cached: opendir() error");
+        free(dir);
+        return 1;
+    }
+    long n = 0, total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        if (strlen(de->d_name) == 32 && fstatat(dirfd(d), de->d_name, &st, 0) == 0) {
+            n++;
+            total += st.st_size;
+        }
+    }
+    closedir(d);
+    printf("%s: %ld entries, %ld bytes\n", dir, n, total);
+    free(dir);
+    fflush(stdout);
+    return 0;
+}
+
+
+int cached_command(const CMD *cmdList) {
+    if (cmdList->argc == 2 && strcmp(cmdList->argv[1], "-s") == 0) {
+        return cache_stats();
+    }
+
+    Key k = {0xcbf29ce484222325ULL, 0x6a09e667f3bcc908ULL};
+    int i = 1;
+    for ( ; i + 1 < cmdList->argc; i += 2) {
+        if (strcmp(cmdList->argv[i], "-i") == 0) {
+            hash_file(&k, cmdList->argv[i+1]);
+        }
+        else if (strcmp(cmdList->argv[i], "-e") == 0) {
+            const char *value = getenv(cmdList->argv[i+1]);
+            hash_string(&k, cmdList->argv[i+1]);
+            hash_string(&k, value ? value : "(unset)");
+        }
+        else {
+            break;
+        }
+    }
+    if (i >= cmdList->argc) {
+        fprintf(stderr, "usage: cached [-i FILE]... [-e VAR]... command [arg]...\n");
+        return 2;
+    }
+
+    // what the command does and what it reads
+    for (int j = i; j < cmdList->argc; j++) {
+        hash_string(&k, cmdList->argv[j]);
+    }
+    char *cwd = get_current_dir_name();
+    hash_string(&k, cwd ? cwd : "");
+    free(cwd);
+    const char *path = getenv("PATH");
+    hash_string(&k, path ? path : "");
+    if (cmdList->fromType == RED_IN) {
+        hash_file(&k, cmdList->fromFile);
+        return cache_run(cmdList, i, k);
+    }
+    if (cmdList->fromType == RED_IN_HERE) {
+        hash_string(&k, cmdList->fromFile);
+        return cache_run(cmdList, i, k);
+    }
+
+    // an inherited stdin: a file is keyed as for <, plus where it is read
+    // from; a pipe or socket is read to the end, keyed by its contents, and
+    // given to the command from a memfd; anything else (a terminal or a
+    // device) cannot be keyed, so the command runs uncached
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) < 0) {
+        st.st_mode = 0;
+    }
+    if (S_ISREG(st.st_mode)) {
+        hash_stat(&k, &st);
+        int64_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+        hash_bytes(&k, &offset, sizeof(offset));
+        return cache_run(cmdList, i, k);
+    }
+    if (!S_ISFIFO(st.st_mode) && !S_ISSOCK(st.st_mode)) {
+        return run_command(cmdList, i);
+    }
+    int input = read_input(&k);
+    if (input < 0) {
+        return 1;
+    }
+    int saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+    dup2(input, STDIN_FILENO);
+    close(input);
+    int status = cache_run(cmdList, i, k);
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdin);
+    return status;
+}
+
+
+static int cache_run(const CMD *cmdList, int first, Key k) {
+    char *dir = cache_dir();
+    if (dir == NULL) {
+        fprintf(stderr, "cached: no cache directory\n");
+        return 1;
+    }
+    char *name;
+    if (asprintf(&name, "%s/%016llx%016llx", dir, (unsigned long long) k.a,
+                 (unsigned long long) k.b) < 0) {
+        free(dir);
+        return 1;
+    }
+
+    // hit: replay without forking, and mark as recently used
+    int fd = open(name, O_RDONLY|O_CLOEXEC);
+    if (fd >= 0) {
+        int status = replay(fd);
+        close(fd);
+        if (status >= 0) {
+            utimensat(AT_FDCWD, name, NULL, 0);
+            stat_add(ST_CACHE_HITS, 1);
+            free(name);
+            free(dir);
+            return status;
+        }
+    }
+    stat_add(ST_CACHE_MISSES, 1);
+
+    // miss: run with stdout sent to a new entry, after a placeholder header
+    char *tmp;
+    if (asprintf(&tmp, "%s/tmp.XXXXXX", dir) < 0) {
+        free(name);
+        free(dir);
+        return 1;
+    }
+    free(dir);
+    Header h = {CACHED_MAGIC, 0, 0, 0};
+    fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0) {
+        perror("cached: mkstemp() error");
+        free(tmp);
+        free(name);
+        return 1;
+    }
+    if (write(fd, &h, sizeof(h)) != sizeof(h)) {
+        perror("cached: write error");
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        free(name);
+        return 1;
+    }
+
+    // neither the entry nor the saved stdout is inherited by the command
+    fflush(stdout);
+    int saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+    dup2(fd, STDOUT_FILENO);
+    int status = run_command(cmdList, first);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    // fill in the header, show the output, and keep it unless killed
+    off_t end = lseek(fd, 0, SEEK_END);
+    h.status = status;
+    h.length = end - sizeof(h);
+    if (copy_out(fd, sizeof(h), h.length) < 0) {
+        perror("cached: write error");
+    }
+    if (status < 128 && pwrite(fd, &h, sizeof(h), 0) == sizeof(h)
+            && rename(tmp, name) == 0) {
+        *strrchr(tmp, '/') = '\0';
+        evict(tmp);
+    }
+    else {
+        unlink(tmp);
+    }
+    close(fd);
+    free(tmp);
+    free(name);
+    return status;
+}
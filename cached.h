@@ -0,0 +1,44 @@
+// cached.h
+//
+// Output cache for commands that are pure functions of their inputs.
+//
+//   cached [-i FILE]... [-e VAR]... command [arg]...
+//
+// runs COMMAND (through simple_command()) unless an earlier run with the
+// same key is in the cache, in which case its stdout and status are
+// replayed without forking.  The key is a 128-bit hash of
+//
+//   - the arguments, the working directory, and PATH
+//   - the value of each VAR given with -e
+//   - the device, inode, size, and modification time of the file that
+//     stdin is redirected from with <, and of each FILE given with -i
+//   - the text of a here document
+//   - for a stdin that is not redirected: if it is a file, its identity as
+//     for < and the offset it is read from; if it is a pipe or a socket,
+//     all of its contents, which are read before the lookup and given to
+//     the command from memory on a miss
+//
+// With any other stdin (a terminal or a device) the command is run and
+// nothing is cached, since what it reads cannot be known in advance.
+//
+// Files are keyed by identity, size, and modification time rather than by
+// their contents, so a key costs a stat() however large the file.  A change
+// that keeps the size and the modification time (e.g. one restored with
+// "touch -r", or two writes within the file system's timestamp resolution)
+// is not noticed, and the old output is replayed; when that matters, pass
+// a checksum of the file in a variable named with -e, or clear the cache.
+//
+// Only stdout and the status are kept (stderr is not), and not for a
+// command killed by a signal.  Output is written to the cache as the
+// command runs and copied to stdout when it exits.
+//
+// Entries live in $CACHED_DIR (default $HOME/.cache/bsh-cached), one file
+// each.  A hit updates the entry's modification time, and after each store
+// the least recently used entries are removed until the cache is no larger
+// than $CACHED_MAX bytes (default 64 MiB).  "cached -s" reports the size of
+// the cache; hits, misses, and evictions are counted by shellstat.
+
+#include "process.h"
+
+// Built-in cached (with its redirections already applied); return status
+int cached_command (const CMD *cmdList);
@@ -0,0 +1,202 @@
+#include "compile.h"
+
+
+// FUNCTION DECLARATIONS
+// append instruction to program and return its index
+static int emit(Program *prog, int op, const CMD *cmd);
+// compile an <and-or> list, in the background if bg is set
+static void emit_and_or(Program *prog, const CMD *cmdList, bool bg);
+
+
+Program *compile(const CMD *cmdList) {
+    Program *prog = malloc(sizeof(Program));
+    prog->n = 0;
+    prog->size = 16;
+    prog->code = malloc(prog->size * sizeof(Insn));
+
+    // collect the left spine of ; and & nodes; spine[0] is the root
+    int nSpine = 0;
+    int sizeSpine = 16;
+    const CMD **spine = malloc(sizeSpine * sizeof(*spine));
+    // bg[i] is set if the last <and-or> under spine[i] runs in the background
+    bool *bg = malloc(sizeSpine * sizeof(*bg));
+
+    const CMD *c = cmdList;
+    bool c_bg = false;
+    while (c != NULL && (c->type == SEP_END || c->type == SEP_BG)) {
+        if (nSpine == sizeSpine) {
+            sizeSpine *= 2;
+            REALLOC(spine, sizeSpine);
+            REALLOC(bg, sizeSpine);
+        }
+        spine[nSpine] = c;
+        bg[nSpine] = c_bg;
+        nSpine++;
+
+        // "X & Y" backgrounds the last <and-or> of X; "X &" (no Y) and
+        // "X ;" pass the setting of the enclosing node down to X
+        if (c->right != NULL) {
+            c_bg = (c->type == SEP_BG);
+        }
+        else {
+            c_bg = c_bg || (c->type == SEP_BG);
+        }
+        c = c->left;
+    }
+
+    // emit the leftmost <and-or>, then the right child of each spine node
+    // from the bottom of the spine up
+    if (c != NULL) {
+        emit_and_or(prog, c, c_bg);
+    }
+    for (int i = nSpine - 1; i >= 0; i--) {
+        if (spine[i]->right != NULL) {
+            emit_and_or(prog, spine[i]->right, bg[i]);
+        }
+    }
+    emit(prog, OP_HALT, NULL);
+
+    free(spine);
+    free(bg);
+    return prog;
+}
+
+
+static void emit_and_or(Program *prog, const CMD *cmdList, bool bg) {
+    // the whole list is a single background job
+    if (bg) {
+        emit(prog, OP_BG, cmdList);
+        return;
+    }
+
+    // count the left spine of && and || nodes
+    int depth = 0;
+    const CMD *c = cmdList;
+    while (c->type == SEP_AND || c->type == SEP_OR) {
+        depth++;
+        c = c->left;
+    }
+
+    // collect it bottom-up so nodes[0] is the deepest operator
+    const CMD **nodes = malloc((depth + 1) * sizeof(*nodes));
+    c = cmdList;
+    for (int i = depth - 1; i >= 0; i--) {
+        nodes[i] = c;
+        c = c->left;
+    }
+
+    // A && B || C  =>  RUN A; JUMP_IF_FAIL L1; RUN B; L1: JUMP_IF_OK L2;
+    //                  RUN C; L2:
+    emit(prog, OP_RUN, c);
+    for (int i = 0; i < depth; i++) {
+        int op = (nodes[i]->type == SEP_AND) ? OP_JUMP_IF_FAIL : OP_JUMP_IF_OK;
+        int jump = emit(prog, op, NULL);
+        emit(prog, OP_RUN, nodes[i]->right);
+        prog->code[jump].target = prog->n;
+    }
+
+    free(nodes);
+}
+
+
+static int emit(Program *prog, int op, const CMD *cmd) {
+    if (prog->n == prog->size) {
+        prog->size *= 2;
+        REALLOC(prog->code, prog->size);
+    }
+    prog->code[prog->n].op = op;
+    prog->code[prog->n].target = -1;
+    prog->code[prog->n].cmd = cmd;
+    return prog->n++;
+}
+
+
+int execute(const Program *prog) {
+    // status register; mirrors $?
+    int status = 0;
+
+    for (int pc = 0; pc < prog->n; pc++) {
+        const Insn *in = &prog->code[pc];
+
+        switch (in->op) {
+            case OP_RUN:
+                status = process(in->cmd);
+                break;
+
+            case OP_BG:
+            {
+                int r = reap_zombies();
+                if (r != 0) {
+                    status = r;
+                    break;
+                }
+                status = background_command_helper(in->cmd);
+                env_variable(status);
+                break;
+            }
+
+            case OP_JUMP_IF_FAIL:
+                if (status != 0) {
+                    pc = in->target - 1;
+                }
+                break;
+
+            case OP_JUMP_IF_OK:
+                if (status == 0) {
+                    pc = in->target - 1;
+                }
+                break;
+
+            case OP_HALT:
+                env_variable(status);
+                return status;
+
+            default:
+                break;
+        }
+    }
+
+    env_variable(status);
+    return status;
+}
+
+
+void dumpProgram(const Program *prog) {
+    static const char *names[] = {
+        "RUN", "BG", "JUMP_IF_FAIL", "JUMP_IF_OK", "HALT"
+    };
+
+    for (int pc = 0; pc < prog->n; pc++) {
+        const Insn *in = &prog->code[pc];
+        printf("%4d  %-12s", pc, names[in->op]);
+
+        if (in->op == OP_JUMP_IF_FAIL || in->op == OP_JUMP_IF_OK) {
+            printf("  -> %d", in->target);
+        }
+        else if (in->cmd != NULL && in->cmd->type == SIMPLE) {
+            for (char **q = in->cmd->argv; *q; q++) {
+                printf(" %s", *q);
+            }
+        }
+        else if (in->cmd != NULL && in->cmd->type == PIPE) {
+            printf(" <pipeline>");
+        }
+        else if (in->cmd != NULL && in->cmd->type == SUBCMD) {
+            printf(" <subcommand>");
+        }
+        else if (in->cmd != NULL) {
+            printf(" <and-or>");
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+
+void freeProgram(Program *prog) {
+    if (prog == NULL) {
+        return;
+    }
+    free(prog->code);
+    free(prog);
+}
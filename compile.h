@@ -0,0 +1,42 @@
+// compile.h
+//
+// Lowers a CMD tree into a flat, contiguous instruction stream and executes
+// it with an iterative interpreter.  Chains of ;, &, &&, and || become
+// straight-line code with conditional jumps, so executing them needs no
+// recursion however long the chain is.  Stages (SIMPLE, PIPE, and SUBCMD)
+// are still executed by process().
+
+#include "process.h"
+
+// Opcodes
+enum {
+    OP_RUN,             // Run stage cmd in the foreground; status = result
+    OP_BG,              // Run and-or list cmd in the background; status = 0
+    OP_JUMP_IF_FAIL,    // Jump to target if status != 0 (&&)
+    OP_JUMP_IF_OK,      // Jump to target if status == 0 (||)
+    OP_HALT             // Stop executing
+};
+
+typedef struct insn {
+    int op;             // Opcode
+    int target;         // Jump target (index into code[]) or -1
+    const CMD *cmd;     // Stage or and-or list for OP_RUN / OP_BG, or NULL
+} Insn;
+
+typedef struct program {
+    int n;              // Number of instructions in code[]
+    int size;           // Number of instructions allocated
+    Insn *code;         // Instructions; the tree they point into must
+} Program;              //   outlive the program
+
+// Compile command tree CMDLIST into a program and return a pointer to it
+Program *compile (const CMD *cmdList);
+
+// Execute program PROG and return status of last command executed
+int execute (const Program *prog);
+
+// Print the instructions in program PROG
+void dumpProgram (const Program *prog);
+
+// Free program PROG (but not the tree it points into)
+void freeProgram (Program *prog);
@@ -0,0 +1,273 @@
+#include "coproc.h"
+#include "jobs.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+
+// lowest descriptor given to the shell's end of a coprocess pipe
+#define COPROC_FD_MIN 10
+
+// a coprocess started by the shell
+typedef struct {
+    char *name;         // NAME, or NULL if the slot is free
+    int pid;            // process ID and process group
+    int in;             // shell's end of the pipe to its stdin
+    int out;            // shell's end of the pipe from its stdout
+    int pidfd;          // pidfd of pid, opened when it was forked
+} Coproc;
+
+static Coproc *coprocs = NULL;
+static int nCoprocs = 0;
+
+
+// FUNCTION DECLARATIONS
+// return true if s is a valid variable name
+static bool valid_name(const char *s);
+// return the coprocess named name, or NULL
+static Coproc *find_coproc(const char *name);
+// close the descriptors of c, end its process group, and free its slot
+static void end_coproc(Coproc *c);
+// end every coprocess (at the shell's exit)
+static void end_all(void);
+// set NAME_suffix to the decimal value n
+static void set_var(const char *name, const char *suffix, int n);
+// move descriptor fd to COPROC_FD_MIN or above, close-on-exec; return it or -1
+static int move_fd(int fd);
+// return true if the process of c has not been reaped
+static bool unreaped(const Coproc *c);
+
+
+static bool valid_name(const char *s) {
+    if (!(*s == '_' || (*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z'))) {
+        return false;
+    }
+    for (s++; *s != '\0'; s++) {
+        if (!(*s == '_' || (*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z')
+                || (*s >= '0' && *s <= '9'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static Coproc *find_coproc(const char *name) {
+    for (int i = 0; i < nCoprocs; i++) {
+        if (coprocs[i].name != NULL && strcmp(coprocs[i].name, name) == 0) {
+            return &coprocs[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void end_coproc(Coproc *c) {
+    // closing its stdin first lets a coprocess that reads to the end finish
+    close(c->in);
+    close(c->out);
+
+    // until the process is reaped its ID, and so that of its group, cannot
+    // be reused; reap_zombies() may have reaped it already, so ask the
+    // pidfd held since the fork, not the ID
+    if (unreaped(c)) {
+        kill(-c->pid, SIGTERM);
+        kill(-c->pid, SIGCONT);
+        struct pollfd p = {c->pidfd, POLLIN, 0};
+        if (poll(&p, 1, 1000) == 0) {
+            kill(-c->pid, SIGKILL);
+        }
+        siginfo_t info;
+        waitid(P_PIDFD, c->pidfd, &info, WEXITED);
+    }
+    close(c->pidfd);
+
+    free(c->name);
+    c->name = NULL;
+}
+
+
+static void end_all(void) {
+    // children that exit() run this too; only the shell owns the coprocesses
+    if (!job_shell()) {
+        return;
+    }
+    for (int i = 0; i < nCoprocs; i++) {
+        if (coprocs[i].name != NULL) {
+            end_coproc(&coprocs[i]);
+        }
+    }
+}
+
+
+static void set_var(const char *name, const char *suffix, int n) {
+    char var[strlen(name) + strlen(suffix) + 1];
+    char value[12];
+    sprintf(var, "%s%s", name, suffix);
+    sprintf(value, "%d", n);
+    setenv(var, value, 1);
+}
+
+
+static int move_fd(int fd) {
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, COPROC_FD_MIN);
+    close(fd);
+    return moved;
+}
+
+
+static bool unreaped(const Coproc *c) {
+    siginfo_t info;
+    return c->pidfd >= 0
+        && waitid(P_PIDFD, c->pidfd, &info, WEXITED | WNOHANG | WNOWAIT) == 0;
+}
+
+
+int coproc_command(const CMD *cmdList) {
+    // "coproc": list them
+    if (cmdList->argc == 1) {
+        for (int i = 0; i < nCoprocs; i++) {
+            if (coprocs[i].name != NULL) {
+                printf("%s %d %d %d\n", coprocs[i].name, coprocs[i].pid, coprocs[i].in, coprocs[i].out);
+            }
+        }
+        fflush(stdout);
+        return 0;
+    }
+
+    // "coproc -k NAME": end one
+    if (strcmp(cmdList->argv[1], "-k") == 0) {
+        Coproc *c = (cmdList->argc == 3) ? find_coproc(cmdList->argv[2]) : NULL;
+        if (c == NULL) {
+            fprintf(stderr, "coproc: %s: no such coprocess\n", (cmdList->argc == 3) ? cmdList->argv[2] : "-k");
+            return 1;
+        }
+        end_coproc(c);
+        return 0;
+    }
+
+    const char *name = cmdList->argv[1];
+    if (cmdList->argc < 3 || !valid_name(name)) {
+        fprintf(stderr, "usage: coproc NAME command [arg]...\n");
+        return 1;
+    }
+
+    // a NAME whose coprocess has ended may be reused (si_pid stays 0 while
+    // it runs)
+    Coproc *c = find_coproc(name);
+    if (c != NULL) {
+        siginfo_t info = {0};
+        if (unreaped(c) && waitid(P_PIDFD, c->pidfd, &info, WEXITED | WNOHANG) == 0
+                && info.si_pid == 0) {
+            fprintf(stderr, "coproc: %s: already running\n", name);
+            return 1;
+        }
+        close(c->pidfd);
+        close(c->in);
+        close(c->out);
+        free(c->name);
+        c->name = NULL;
+    }
+
+    int to[2];
+    int from[2];
+    if (pipe2(to, O_CLOEXEC) < 0) {
+        int errno2 = errno;
+        perror("pipe() error");
+        env_variable(errno2);
+        return 1;
+    }
+    if (pipe2(from, O_CLOEXEC) < 0) {
+        int errno2 = errno;
+        perror("pipe() error");
+        env_variable(errno2);
+        close(to[0]);
+        close(to[1]);
+        return 1;
+    }
+    int in = move_fd(to[1]);
+    int out = move_fd(from[0]);
+    if (in < 0 || out < 0) {
+        perror("fcntl() error");
+        close(in);
+        close(out);
+        close(to[0]);
+        close(from[1]);
+        return 1;
+    }
+
+    fflush(stdout);
+    int pid = job_fork(false);
+    if (pid < 0) {
+        perror("Fork failure");
+        job_done();
+        close(in);
+        close(out);
+        close(to[0]);
+        close(from[1]);
+        return 1;
+    }
+
+    // child: run the command on the pipes, holding no other coprocess's ends
+    if (pid == 0) {
+        setpgid(0, 0);
+        dup2(to[0], STDIN_FILENO);
+        dup2(from[1], STDOUT_FILENO);
+        close(to[0]);
+        close(from[1]);
+        close(in);
+        close(out);
+        for (int i = 0; i < nCoprocs; i++) {
+            if (coprocs[i].name != NULL) {
+                close(coprocs[i].in);
+                close(coprocs[i].out);
+                close(coprocs[i].pidfd);
+            }
+        }
+        // the arguments are already expanded, so the copy is run as is
+        // rather than through process(), which would expand them again
+        CMD sub = *cmdList;
+        sub.argv = cmdList->argv + 2;
+        sub.argc = cmdList->argc - 2;
+        exit(simple_command(&sub));
+    }
+
+    // parent: the group is the coprocess's own even without job control;
+    // the shell reaps only between commands, so the pidfd opened now
+    // refers to this process and no other
+    setpgid(pid, pid);
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) {
+        perror("pidfd_open() error");
+    }
+    else {
+        pidfd = move_fd(pidfd);
+    }
+    close(to[0]);
+    close(from[1]);
+    job_background(pid, cmdList);
+
+    if (coprocs == NULL) {
+        atexit(end_all);
+    }
+    if (c == NULL) {
+        for (int i = 0; i < nCoprocs && c == NULL; i++) {
+            if (coprocs[i].name == NULL) {
+                c = &coprocs[i];
+            }
+        }
+    }
+    if (c == NULL) {
+        REALLOC(coprocs, nCoprocs + 1);
+        c = &coprocs[nCoprocs++];
+    }
+    c->name = strdup(name);
+    c->pid = pid;
+    c->in = in;
+    c->out = out;
+    c->pidfd = pidfd;
+
+    set_var(name, "_IN", in);
+    set_var(name, "_OUT", out);
+    set_var(name, "_PID", pid);
+    return 0;
+}
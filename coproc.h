@@ -0,0 +1,33 @@
+// coproc.h
+//
+// Built-in "coproc NAME command [arg]..." starts COMMAND as a coprocess: a
+// background job, forked as any simple command, whose stdin and stdout are
+// pipes to the shell.  The shell keeps its ends of the pipes on descriptors
+// numbered 10 or above and sets
+//
+//   NAME_IN   the descriptor to write to COMMAND's stdin (e.g. "echo 1 >&N")
+//   NAME_OUT  the descriptor to read from COMMAND's stdout (e.g. "read X <&N")
+//   NAME_PID  COMMAND's process ID (and process group)
+//
+// so that one long-lived worker can serve many commands of a script.  Both
+// descriptors are close-on-exec, so commands see them only when redirected,
+// and a coprocess does not inherit those of the others; it sees end of file
+// once the shell closes NAME_IN (e.g. "exec N>&-").  The job is listed by
+// "jobs" like any other.
+//
+// "coproc" alone lists the coprocesses as NAME PID IN OUT, and "coproc -k
+// NAME" closes the descriptors of NAME and ends it as at exit, when the shell
+// closes every coprocess's descriptors, sends SIGTERM to its process group,
+// and waits for it (sending SIGKILL if it is still running a second later).
+// A coprocess that has already exited and been reaped is not signaled: the
+// shell holds a pidfd for each from the time it is forked, so a process
+// that later reuses the ID is never mistaken for it.  A NAME may be reused
+// once its coprocess has ended.
+//
+// Status: 0, or 1 if the arguments are invalid, NAME is running, or the
+// pipes or the process cannot be created.
+
+#include "process.h"
+
+// Built-in coproc; return status
+int coproc_command (const CMD *cmdList);
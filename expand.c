@@ -0,0 +1,979 @@
+#include "expand.h"
+#include "shellstat.h"
+#include "lex.h"
+#include "pathexp.h"
+#include "arith.h"
+#include "param.h"
+#include "jobs.h"
+#include <sys/mman.h>
+#include <ctype.h>
+
+
+// bytes the tokenizer treats specially
+#define SH_SPECIAL " \t\n<>;&|()'\"\\#"
+
+// bytes special in pathname patterns
+#define GLOB_SPECIAL "*?[\\"
+
+
+// growable string
+typedef struct buf {
+    char *s;            // contents (NUL-terminated)
+    size_t n;           // length
+    size_t size;        // bytes allocated
+} Buf;
+
+// process substitution
+typedef struct subst {
+    int fd;             // shell's end of the pipe
+    int pid;            // process running the command
+} Subst;
+
+// copy made by expandCMD(), with the descriptor redirections of the stage
+// and the process substitutions started for it
+typedef struct expanded {
+    CMD cmd;                    // first, so a CMD * is an Expanded *
+    FdRedir *redirs;
+    int nRedir;
+    Subst *substs;
+    int nSubst, sizeSubst;
+    struct expanded *next;      // other copies not yet freed
+} Expanded;
+
+static Expanded *live = NULL;
+
+// copy whose words are being expanded (a $(...) in them may expand others)
+static Expanded *building = NULL;
+
+// space for values built by parameter expansion, reused by each
+static ParamBuf scratch = {NULL, 0, 0};
+
+
+// FUNCTION DECLARATIONS
+// append n bytes of s to b
+static void buf_putn(Buf *b, const char *s, size_t n);
+// append string s to b
+static void buf_puts(Buf *b, const char *s);
+// return index of the ) matching the ( at line[open], or -1
+static int match_paren(const char *line, int open);
+// append construct s[0..n) to b in shielded form, marked if quoted
+static void put_shielded(Buf *b, const char *s, size_t n, bool quoted);
+// decode the construct starting at s[0] == SH_BEGIN onto text, setting
+// *quoted if it is marked (unless quoted is NULL); return the position after it
+static const char *decode(const char *s, Buf *text, bool *quoted);
+// return true if word w is just a descriptor redirection, storing it in *r
+static bool redir_word(const char *w, FdRedir *r);
+// return malloc()-ed expansion of word w; if pat != NULL, append to it the
+// expansion as a pattern, with quoted and substituted text escaped; if kept
+// != NULL, set *kept unless w is made only of unquoted constructs
+static char *expand_word(const char *w, Buf *pat, bool *kept);
+// append s[0..n) to pattern pat, escaping special bytes if literal
+static void put_pattern(Buf *pat, const char *s, size_t n, bool literal);
+// append the expansion of argument w to the array argv[0..*argc)
+static void expand_arg(char ***argv, int *argc, int *size, const char *w);
+// expand the decoded construct s[0..n) onto b; return 0 or -1
+static int expand_construct(Buf *b, const char *s, size_t n);
+// return malloc()-ed here document doc with each $(...) expanded
+static char *expand_here(const char *doc);
+// return the length of the [N]>&$NAME or [N]<&$NAME at line[i], or 0
+static size_t fd_var_length(const char *line, int i);
+// return the length of the unquoted descriptor redirection operator at
+// line[i] that shield() makes a word of its own, or 0; store it in *r
+static size_t fd_redir_length(const char *line, int i, FdRedir *r);
+// return the index just past the word at line[i]
+static int word_end(const char *line, int i);
+// blank out the descriptor redirections (and their FILEs) that follow the )
+// at line[close], and return them shielded as "exec ... ;" (NULL if none)
+static char *move_redirs(char *line, int close);
+// return true if line[i..] starts a $((...)) that ends at line[*end]
+static bool is_arith(const char *line, int i, int *end);
+// append the output of command text, less trailing newlines, to b; return
+// 0 or -1
+static int command_subst(Buf *b, const char *text);
+// return true if cmd consists only of builtins that may run in the shell
+static bool pure_builtins(const CMD *cmd);
+// run cmd in the shell with stdout captured onto b
+static void capture_inline(Buf *b, const CMD *cmd);
+// run cmd in a child with stdout captured onto b through a pipe
+static void capture_fork(Buf *b, const CMD *cmd);
+// start command text for <(...) (dir = 0) or >(...) (dir = 1); return fd
+static int process_subst(const char *text, int dir);
+
+
+static void buf_putn(Buf *b, const char *s, size_t n) {
+    if (b->n + n + 1 > b->size) {
+        b->size = 2 * (b->n + n + 1);
+        REALLOC(b->s, b->size);
+    }
+    memcpy(b->s + b->n, s, n);
+    b->n += n;
+    b->s[b->n] = '\0';
+}
+
+
+static void buf_puts(Buf *b, const char *s) {
+    buf_putn(b, s, strlen(s));
+}
+
+
+char *shield(const char *text) {
+    Buf out = {NULL, 0, 0};
+    buf_putn(&out, "", 0);
+
+    // redirections after a subshell's ) are moved, so work on a copy
+    char *line = strdup(text);
+    size_t opens[64];                   // where each unclosed ( is in out
+    int nOpen = 0;
+
+    int quote = 0;
+    for (int i = 0; line[i]; i++) {
+        char c = line[i];
+
+        // '...' is literal
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+            if (strchr("*?[", c)) {
+                put_shielded(&out, &c, 1, true);    // not a pattern
+                continue;
+            }
+            buf_putn(&out, &c, 1);
+            continue;
+        }
+        // \x is literal (inside "..." too)
+        if (c == '\\' && line[i+1]) {
+            if (strchr("*?[", line[i+1])) {
+                if (quote == '"') {
+                    buf_putn(&out, &c, 1);      // "\*" keeps the backslash
+                }
+                put_shielded(&out, line + i + 1, 1, quote == '"');
+            }
+            else {
+                buf_putn(&out, line + i, 2);
+            }
+            i++;
+            continue;
+        }
+
+        // $NAME, $?, and ${...}, also inside "..."
+        size_t len = param_length(line + i);
+        if (len > 0) {
+            put_shielded(&out, line + i, len, quote == '"');
+            i += len - 1;
+            continue;
+        }
+
+        // $((...)) and $(...), also inside "..."
+        int end;
+        if (c == '$' && is_arith(line, i, &end)) {
+            put_shielded(&out, line + i, end - i + 1, quote == '"');
+            i = end;
+            continue;
+        }
+        if (c == '$' && line[i+1] == '(' && (end = match_paren(line, i + 1)) >= 0) {
+            put_shielded(&out, line + i, end - i + 1, quote == '"');
+            i = end;
+            continue;
+        }
+
+        if (quote == '"') {
+            if (c == '"') {
+                quote = 0;
+            }
+            if (strchr("*?[", c)) {
+                put_shielded(&out, &c, 1, true);
+                continue;
+            }
+            buf_putn(&out, &c, 1);
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            // "" or '' leaves an argument even next to a reference that
+            // expands to nothing, so mark it as an empty quoted construct
+            if (line[i+1] == c) {
+                put_shielded(&out, "", 0, true);
+            }
+            quote = c;
+            buf_putn(&out, &c, 1);
+            continue;
+        }
+
+        // N>FILE, >&M, >&$NAME, and the like, as a word of their own
+        FdRedir r;
+        if ((len = fd_redir_length(line, i, &r)) > 0) {
+            buf_putn(&out, " ", 1);
+            put_shielded(&out, line + i, len, false);
+            buf_putn(&out, " ", 1);
+            i += len - 1;
+            continue;
+        }
+
+        // <(...) and >(...)
+        if ((c == '<' || c == '>') && line[i+1] == '(') {
+            int end = match_paren(line, i + 1);
+            if (end >= 0) {
+                put_shielded(&out, line + i, end - i + 1, false);
+                i = end;
+                continue;
+            }
+        }
+
+        // the parser takes no words after a subshell, so its descriptor
+        // redirections become an exec at the start of its body, applied
+        // there after its < and > as for any other command
+        if (c == '(' && nOpen < 64) {
+            opens[nOpen++] = out.n;
+        }
+        else if (c == ')' && nOpen > 0) {
+            size_t at = opens[--nOpen] + 1;
+            char *moved = move_redirs(line, i);
+            if (moved != NULL) {
+                size_t n = strlen(moved);
+                buf_putn(&out, moved, n);
+                memmove(out.s + at + n, out.s + at, out.n - n - at);
+                memcpy(out.s + at, moved, n);
+                free(moved);
+            }
+        }
+        buf_putn(&out, &c, 1);
+    }
+    free(line);
+    return out.s;
+}
+
+
+static size_t fd_redir_length(const char *line, int i, FdRedir *r) {
+    size_t len = fd_var_length(line, i);
+    if (len > 0) {
+        r->op = FD_DUP;
+        return len;
+    }
+    char c = line[i];
+    if ((c == '<' || c == '>' || (isdigit((unsigned char) c)
+            && (i == 0 || strchr(" \t\n;&|()", line[i-1]))))
+            && (len = fd_parse(line + i, r)) > 0 && line[i+len] != '('
+            && (r->op == FD_DUP || r->op == FD_CLOSE || !(c == '<' || c == '>'))) {
+        return len;
+    }
+    return 0;
+}
+
+
+static int word_end(const char *line, int i) {
+    while (line[i] && !strchr(" \t\n;&|()<>", line[i])) {
+        if (line[i] == '\'' || line[i] == '"') {
+            const char *q = strchr(line + i + 1, line[i]);
+            i = q ? q - line : (int) strlen(line) - 1;
+        }
+        else if (line[i] == '\\' && line[i+1]) {
+            i++;
+        }
+        i++;
+    }
+    return i;
+}
+
+
+static char *move_redirs(char *line, int close) {
+    Buf raw = {NULL, 0, 0};
+    buf_puts(&raw, " exec");
+    bool found = false;
+
+    // < and > (with their FILEs) stay for the parser
+    int j = close + 1;
+    for (;;) {
+        j += strspn(line + j, " \t");
+        FdRedir r;
+        size_t len = fd_redir_length(line, j, &r);
+        if (len > 0) {
+            int end = j + len;
+            if (r.op == FD_IN || r.op == FD_OUT || r.op == FD_APP) {
+                end += strspn(line + end, " \t");
+                end = word_end(line, end);
+            }
+            buf_putn(&raw, " ", 1);
+            buf_putn(&raw, line + j, end - j);
+            memset(line + j, ' ', end - j);
+            j = end;
+            found = true;
+        }
+        else if ((line[j] == '<' || line[j] == '>') && line[j+1] != '(') {
+            j += strspn(line + j, "<>");
+            j += strspn(line + j, " \t");
+            j = word_end(line, j);
+        }
+        else {
+            break;
+        }
+    }
+    if (!found) {
+        free(raw.s);
+        return NULL;
+    }
+    buf_puts(&raw, " ;");
+    char *moved = shield(raw.s);
+    free(raw.s);
+    return moved;
+}
+
+
+static size_t fd_var_length(const char *line, int i) {
+    int j = i;
+    if (isdigit((unsigned char) line[j])) {
+        if (i > 0 && !strchr(" \t\n;&|()", line[i-1])) {
+            return 0;
+        }
+        while (isdigit((unsigned char) line[j])) {
+            j++;
+        }
+    }
+    if ((line[j] != '<' && line[j] != '>') || line[j+1] != '&') {
+        return 0;
+    }
+    size_t len = param_length(line + j + 2);
+    return (len > 0) ? j + 2 + len - i : 0;
+}
+
+
+static bool is_arith(const char *line, int i, int *end) {
+    if (line[i] != '$' || line[i+1] != '(' || line[i+2] != '(') {
+        return false;
+    }
+    *end = match_paren(line, i + 1);
+    return *end > 0 && match_paren(line, i + 2) == *end - 1;
+}
+
+
+static int match_paren(const char *line, int open) {
+    int depth = 0;
+    int quote = 0;
+    for (int i = open; line[i]; i++) {
+        char c = line[i];
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+        }
+        else if (c == '\\' && line[i+1]) {
+            i++;
+        }
+        else if (quote == '"') {
+            if (c == '"') {
+                quote = 0;
+            }
+        }
+        else if (c == '\'' || c == '"') {
+            quote = c;
+        }
+        else if (c == '(') {
+            depth++;
+        }
+        else if (c == ')' && --depth == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static void put_shielded(Buf *b, const char *s, size_t n, bool quoted) {
+    char c = SH_BEGIN;
+    buf_putn(b, &c, 1);
+    if (quoted) {
+        c = SH_QUOTE;
+        buf_putn(b, &c, 1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] != '\0' && strchr(SH_SPECIAL, s[i])) {
+            char esc[2] = {SH_ESC, s[i] ^ 0x80};
+            buf_putn(b, esc, 2);
+        }
+        else {
+            buf_putn(b, s + i, 1);
+        }
+    }
+    c = SH_END;
+    buf_putn(b, &c, 1);
+}
+
+
+CMD *expandCMD(const CMD *cmdList) {
+    // nothing to do unless some word contains a shielded construct or
+    // might be a pattern
+    bool found = false;
+    for (int i = 0; i < cmdList->argc && !found; i++) {
+        found = strpbrk(cmdList->argv[i], "\002*?[") != NULL;
+    }
+    for (int i = 0; i < cmdList->nLocal && !found; i++) {
+        found = strchr(cmdList->locVal[i], SH_BEGIN) != NULL;
+    }
+    if (cmdList->fromType == RED_IN && strchr(cmdList->fromFile, SH_BEGIN)) {
+        found = true;
+    }
+    if (cmdList->toFile != NULL && strchr(cmdList->toFile, SH_BEGIN)) {
+        found = true;
+    }
+    if (cmdList->errFile != NULL && strchr(cmdList->errFile, SH_BEGIN)) {
+        found = true;
+    }
+    if (cmdList->fromType == RED_IN_HERE && strstr(cmdList->fromFile, "$(")) {
+        found = true;
+    }
+    if (!found) {
+        return NULL;
+    }
+
+    // copy owns every string so freeCMD() can release it
+    Expanded *e = malloc(sizeof(*e));
+    e->redirs = NULL;
+    e->nRedir = 0;
+    e->substs = NULL;
+    e->nSubst = e->sizeSubst = 0;
+    e->next = live;
+    live = e;
+    Expanded *outer = building;
+    building = e;
+    CMD *copy = &e->cmd;
+    *copy = *cmdList;
+    copy->locVar = NULL;
+    copy->locVal = NULL;
+    copy->fromFile = NULL;
+    copy->toFile = NULL;
+    copy->errFile = NULL;
+
+    int size = cmdList->argc + 1;
+    copy->argc = 0;
+    copy->argv = malloc(size * sizeof(char *));
+    for (int i = 0; i < cmdList->argc; i++) {
+        FdRedir r;
+        if (!redir_word(cmdList->argv[i], &r)) {
+            expand_arg(&copy->argv, &copy->argc, &size, cmdList->argv[i]);
+            continue;
+        }
+        if (r.op == FD_IN || r.op == FD_OUT || r.op == FD_APP) {
+            if (i + 1 == cmdList->argc) {
+                fprintf(stderr, "Redirection: missing file name\n");
+                continue;
+            }
+            r.file = expand_word(cmdList->argv[++i], NULL, NULL);
+        }
+        REALLOC(e->redirs, e->nRedir + 1);
+        e->redirs[e->nRedir++] = r;
+    }
+    // a stage of redirections alone runs :
+    if (copy->argc == 0) {
+        copy->argv[copy->argc++] = strdup(":");
+    }
+    copy->argv[copy->argc] = NULL;
+
+    if (cmdList->nLocal > 0) {
+        copy->locVar = malloc(cmdList->nLocal * sizeof(char *));
+        copy->locVal = malloc(cmdList->nLocal * sizeof(char *));
+        for (int i = 0; i < cmdList->nLocal; i++) {
+            copy->locVar[i] = strdup(cmdList->locVar[i]);
+            copy->locVal[i] = expand_word(cmdList->locVal[i], NULL, NULL);
+        }
+    }
+
+    if (cmdList->fromFile != NULL) {
+        copy->fromFile = (cmdList->fromType == RED_IN)
+            ? expand_word(cmdList->fromFile, NULL, NULL)
+            : expand_here(cmdList->fromFile);
+    }
+    if (cmdList->toFile != NULL) {
+        copy->toFile = expand_word(cmdList->toFile, NULL, NULL);
+    }
+    if (cmdList->errFile != NULL) {
+        copy->errFile = expand_word(cmdList->errFile, NULL, NULL);
+    }
+    building = outer;
+    return copy;
+}
+
+
+void freeExpanded(CMD *cmdList) {
+    if (cmdList == NULL) {
+        return;
+    }
+    // subtrees belong to the original
+    cmdList->left = NULL;
+    cmdList->right = NULL;
+
+    Expanded *e = (Expanded *) cmdList;
+    for (Expanded **p = &live; *p; p = &(*p)->next) {
+        if (*p == e) {
+            *p = e->next;
+            break;
+        }
+    }
+    for (int i = 0; i < e->nRedir; i++) {
+        free(e->redirs[i].file);
+    }
+    free(e->redirs);
+    freeCMD(cmdList);
+
+    // close our ends so >(...) readers see EOF, then wait for them; those
+    // of other copies (an outer command's, say) stay open
+    for (int i = 0; i < e->nSubst; i++) {
+        close(e->substs[i].fd);
+    }
+    for (int i = 0; i < e->nSubst; i++) {
+        int status;
+        waitpid(e->substs[i].pid, &status, 0);
+    }
+    free(e->substs);
+}
+
+
+static void expand_arg(char ***argv, int *argc, int *size, const char *w) {
+    Buf pat = {NULL, 0, 0};
+    buf_putn(&pat, "", 0);
+    bool kept = false;
+    char *word = expand_word(w, &pat, &kept);
+
+    // unquoted references that expand to nothing leave no argument
+    if (word[0] == '\0' && !kept) {
+        free(word);
+        free(pat.s);
+        return;
+    }
+
+    // a pattern that matches nothing is left as is
+    char **matches = NULL;
+    int n = 0;
+    if (getenv("NOGLOB") == NULL && pattern_magic(pat.s, pat.n)) {
+        n = pathexp(pat.s, &matches);
+    }
+    free(pat.s);
+
+    if (*argc + n + 2 > *size) {
+        *size = 2 * (*argc + n + 2);
+        REALLOC(*argv, *size);
+    }
+    if (n == 0) {
+        (*argv)[(*argc)++] = word;
+        return;
+    }
+    free(word);
+    memcpy(*argv + *argc, matches, n * sizeof(char *));
+    *argc += n;
+    free(matches);
+}
+
+
+static void put_pattern(Buf *pat, const char *s, size_t n, bool literal) {
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '\\' || (literal && strchr(GLOB_SPECIAL, s[i]))) {
+            buf_putn(pat, "\\", 1);
+        }
+        buf_putn(pat, s + i, 1);
+    }
+}
+
+
+const FdRedir *fdRedirs(const CMD *cmdList, int *n) {
+    for (Expanded *e = live; e; e = e->next) {
+        // or a copy of it on the stack, less a built-in's leading words
+        if (&e->cmd == cmdList || (cmdList->argc > 0 && cmdList->argv > e->cmd.argv
+                && cmdList->argv < e->cmd.argv + e->cmd.argc)) {
+            *n = e->nRedir;
+            return e->redirs;
+        }
+    }
+    *n = 0;
+    return NULL;
+}
+
+
+bool hasFdRedirs(const CMD *cmdList) {
+    FdRedir r;
+    for (int i = 0; i < cmdList->argc; i++) {
+        if (redir_word(cmdList->argv[i], &r)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static const char *decode(const char *s, Buf *text, bool *quoted) {
+    if (s[1] == SH_QUOTE) {
+        s++;
+        if (quoted != NULL) {
+            *quoted = true;
+        }
+    }
+    for (s++; *s && *s != SH_END; s++) {
+        if (*s == SH_ESC && s[1]) {
+            char c = *++s ^ 0x80;
+            buf_putn(text, &c, 1);
+        }
+        else {
+            buf_putn(text, s, 1);
+        }
+    }
+    return (*s == SH_END) ? s + 1 : s;
+}
+
+
+static bool redir_word(const char *w, FdRedir *r) {
+    if (w[0] != SH_BEGIN || strchr(w + 1, SH_BEGIN) != NULL) {
+        return false;
+    }
+    Buf text = {NULL, 0, 0};
+    buf_putn(&text, "", 0);
+    if (*decode(w, &text, NULL) != '\0') {
+        free(text.s);
+        return false;
+    }
+
+    // [N]>&$NAME: put the value in place of the reference
+    char *ref = strstr(text.s, "&$");
+    if (ref != NULL && param_length(ref + 1) == strlen(ref + 1)) {
+        const char *value;
+        size_t length;
+        scratch.n = 0;
+        if (param_expand(ref + 1, strlen(ref + 1), &scratch, &value, &length) == 0) {
+            char *fd = strndup(value, length);
+            text.n = ref + 1 - text.s;
+            buf_puts(&text, fd);
+            free(fd);
+        }
+    }
+    bool ok = (text.n > 0 && fd_parse(text.s, r) == (int) text.n);
+    free(text.s);
+    return ok;
+}
+
+
+static char *expand_word(const char *w, Buf *pat, bool *kept) {
+    Buf b = {NULL, 0, 0};
+    buf_putn(&b, "", 0);
+    bool keep = (*w == '\0');          // literal text or a quoted construct
+
+    while (*w) {
+        const char *begin = strchr(w, SH_BEGIN);
+        keep = keep || begin != w;
+        if (begin == NULL) {
+            if (pat != NULL) {
+                put_pattern(pat, w, strlen(w), false);
+            }
+            buf_puts(&b, w);
+            break;
+        }
+        if (pat != NULL) {
+            put_pattern(pat, w, begin - w, false);
+        }
+        buf_putn(&b, w, begin - w);
+        size_t start = b.n;
+
+        // decode construct
+        Buf text = {NULL, 0, 0};
+        buf_putn(&text, "", 0);
+        w = decode(begin, &text, &keep);
+
+        if (expand_construct(&b, text.s, text.n) < 0) {
+            buf_putn(&b, text.s, text.n);
+        }
+        free(text.s);
+        if (pat != NULL) {
+            put_pattern(pat, b.s + start, b.n - start, true);
+        }
+    }
+    if (kept != NULL) {
+        *kept = keep;
+    }
+    return b.s;
+}
+
+
+static char *expand_here(const char *doc) {
+    Buf b = {NULL, 0, 0};
+    buf_putn(&b, "", 0);
+
+    const char *s;
+    while ((s = strstr(doc, "$(")) != NULL) {
+        buf_putn(&b, doc, s - doc);
+        int end;
+        if (!is_arith(s, 0, &end) && (end = match_paren(s, 1)) < 0) {
+            buf_putn(&b, s, 2);
+            doc = s + 2;
+            continue;
+        }
+        if (expand_construct(&b, s, end + 1) < 0) {
+            buf_putn(&b, s, end + 1);
+        }
+        doc = s + end + 1;
+    }
+    buf_puts(&b, doc);
+    return b.s;
+}
+
+
+static int expand_construct(Buf *b, const char *s, size_t n) {
+    // $NAME, $?, and ${...}
+    if (n >= 2 && s[0] == '$' && param_length(s) == n) {
+        const char *value;
+        size_t length;
+        scratch.n = 0;
+        if (param_expand(s, n, &scratch, &value, &length) < 0) {
+            return -1;
+        }
+        buf_putn(b, value, length);
+        return 0;
+    }
+
+    // $((...))
+    if (n >= 5 && s[0] == '$' && s[1] == '(' && s[2] == '(') {
+        char *expr = strndup(s + 3, n - 5);
+        long long value;
+        int r = arith_eval(expr, &value);
+        free(expr);
+        if (r < 0) {
+            return -1;
+        }
+        char text[24];
+        sprintf(text, "%lld", value);
+        buf_puts(b, text);
+        return 0;
+    }
+
+    // $(...)
+    if (n >= 3 && s[0] == '$' && s[1] == '(' && s[n-1] == ')') {
+        char *text = strndup(s + 2, n - 3);
+        int r = command_subst(b, text);
+        free(text);
+        return r;
+    }
+
+    // <(...) or >(...)
+    if (n >= 3 && (s[0] == '<' || s[0] == '>') && s[1] == '(' && s[n-1] == ')') {
+        char *text = strndup(s + 2, n - 3);
+        int fd = process_subst(text, s[0] == '>');
+        free(text);
+        if (fd < 0) {
+            return -1;
+        }
+        char path[32];
+        sprintf(path, "/dev/fd/%d", fd);
+        buf_puts(b, path);
+        return 0;
+    }
+    return -1;
+}
+
+
+static int command_subst(Buf *b, const char *text) {
+    char *line = shield(text);
+    token *list = lexList(line);
+    free(line);
+    if (list == NULL) {
+        return 0;
+    }
+    CMD *cmd = parse(list);
+    freeLexList(list);
+    if (cmd == NULL) {
+        return -1;
+    }
+
+    // echo and pwd need no fork, but $((...)) and ${X:=...} side effects
+    // would leak out
+    size_t start = b->n;
+    if (pure_builtins(cmd) && strstr(text, "$((") == NULL
+            && !(strstr(text, "${") != NULL && strchr(text, '=') != NULL)) {
+        capture_inline(b, cmd);
+    }
+    else {
+        capture_fork(b, cmd);
+    }
+    freeCMD(cmd);
+
+    while (b->n > start && b->s[b->n-1] == '\n') {
+        b->n--;
+    }
+    b->s[b->n] = '\0';
+    return 0;
+}
+
+
+static bool pure_builtins(const CMD *cmd) {
+    if (cmd == NULL) {
+        return true;
+    }
+    switch (cmd->type) {
+        case SIMPLE:
+            return cmd->nLocal == 0 && cmd->fromType == NONE
+                && cmd->toType == NONE && cmd->errType == NONE
+                && (strcmp(cmd->argv[0], "echo") == 0
+                    || strcmp(cmd->argv[0], "pwd") == 0
+                    || strcmp(cmd->argv[0], ":") == 0);
+        case SEP_AND:
+        case SEP_OR:
+        case SEP_END:
+            return pure_builtins(cmd->left) && pure_builtins(cmd->right);
+        default:
+            return false;
+    }
+}
+
+
+static void capture_inline(Buf *b, const CMD *cmd) {
+    // an anonymous file never fills up the way a pipe would; it and the
+    // saved stdout are kept above the descriptors a command may name, so
+    // that >&3 fails when 3 is closed, as it does in a forked substitution
+    int memfd = memfd_create("subst", MFD_CLOEXEC);
+    if (memfd < 0) {
+        perror("memfd_create");
+        return;
+    }
+    int fd = fcntl(memfd, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+    close(memfd);
+    if (fd < 0) {
+        perror("fcntl() error");
+        return;
+    }
+    fflush(stdout);
+    int saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+    dup2(fd, STDOUT_FILENO);
+    int status = process(cmd);
+    env_variable(status);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size > 0) {
+        if (b->n + size + 1 > b->size) {
+            b->size = b->n + size + 1;
+            REALLOC(b->s, b->size);
+        }
+        ssize_t got = pread(fd, b->s + b->n, size, 0);
+        b->n += (got > 0) ? got : 0;
+        b->s[b->n] = '\0';
+    }
+    close(fd);
+}
+
+
+static void capture_fork(Buf *b, const CMD *cmd) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        perror("Pipe failure");
+        return;
+    }
+    stat_add(ST_PIPES, 1);
+
+    fflush(stdout);
+    stat_add(ST_FORKS, 1);
+    int pid = fork();
+    if (pid < 0) {
+        perror("Fork failure");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return;
+    }
+    if (pid == 0) {
+        job_signals();
+        dup2(pipefd[1], STDOUT_FILENO);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        exit(process(cmd));
+    }
+    close(pipefd[1]);
+
+    // read straight into the buffer, doubling it as it fills
+    for (;;) {
+        if (b->size - b->n < 4096 + 1) {
+            b->size = 2 * b->size + 4096 + 1;
+            REALLOC(b->s, b->size);
+        }
+        ssize_t got = read(pipefd[0], b->s + b->n, b->size - b->n - 1);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break;
+        }
+        b->n += got;
+    }
+    b->s[b->n] = '\0';
+    close(pipefd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    env_variable(STATUS(status));
+}
+
+
+static int process_subst(const char *text, int dir) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        perror("Pipe failure");
+        return -1;
+    }
+    stat_add(ST_PIPES, 1);
+
+    stat_add(ST_FORKS, 1);
+    int pid = fork();
+    if (pid < 0) {
+        perror("Fork failure");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+
+    // child: read end becomes stdin for >(...), write end stdout for <(...)
+    if (pid == 0) {
+        job_signals();
+        if (dir == 1) {
+            dup2(pipefd[0], STDIN_FILENO);
+        }
+        else {
+            dup2(pipefd[1], STDOUT_FILENO);
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+        // don't hold other substitutions' pipes open
+        for (Expanded *e = live; e; e = e->next) {
+            for (int i = 0; i < e->nSubst; i++) {
+                close(e->substs[i].fd);
+            }
+        }
+        exit(run_text(text));
+    }
+
+    // parent keeps the other end open for the command to inherit
+    int fd = (dir == 1) ? pipefd[1] : pipefd[0];
+    close((dir == 1) ? pipefd[0] : pipefd[1]);
+
+    Expanded *e = building;
+    if (e->nSubst == e->sizeSubst) {
+        e->sizeSubst = e->sizeSubst ? 2 * e->sizeSubst : 4;
+        REALLOC(e->substs, e->sizeSubst);
+    }
+    e->substs[e->nSubst].fd = fd;
+    e->substs[e->nSubst].pid = pid;
+    e->nSubst++;
+    return fd;
+}
+
+
+int run_text(const char *text) {
+    char *line = shield(text);
+    token *list = lexList(line);
+    free(line);
+    if (list == NULL) {
+        return 0;
+    }
+
+    CMD *cmd = parse(list);
+    freeLexList(list);
+    if (cmd == NULL) {
+        return 1;
+    }
+
+    int status = process(cmd);
+    freeCMD(cmd);
+    return status;
+}
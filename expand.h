@@ -0,0 +1,80 @@
+// expand.h
+//
+// Word expansion.  The tokenizer in parse.o treats <, >, (, ), etc. as
+// metacharacters, so constructs that contain them, such as <(cmd), would be
+// torn apart before the parser ever saw them.  main() therefore passes each
+// line through shield(), which rewrites every such construct into opaque
+// text that the tokenizer keeps inside a single SIMPLE word.  When a stage
+// is about to run, process() calls expandCMD() to expand those words.
+//
+// A shielded construct is SH_BEGIN, the construct with each byte that the
+// tokenizer treats specially replaced by SH_ESC followed by that byte ^ 0x80,
+// and SH_END.  SH_QUOTE after SH_BEGIN marks a construct inside "...", and
+// SH_BEGIN SH_QUOTE SH_END stands for an empty "" or ''.
+//
+// Constructs:
+//
+//   $NAME, $?    Replaced by the value of the variable, or by the result of
+//   ${...}       the operator (see param.h), as part of the same word (there
+//                is no field splitting, and the value is not a pattern);
+//                also in [N]>&$NAME and [N]<&$NAME.  An argument made up
+//                only of unquoted constructs that expand to nothing is
+//                removed ($NOPE), but one with quotes stays, empty ("$NOPE"
+//                or "").
+//   <(command)   Replaced by /dev/fd/N, where N is the read end of a pipe
+//                from the standard output of COMMAND
+//   >(command)   Replaced by /dev/fd/N, where N is the write end of a pipe
+//                to the standard input of COMMAND
+//   $((expr))    Replaced by the value of the arithmetic expression EXPR
+//                (see arith.h); also expanded in here documents
+//   $(command)   Replaced by the standard output of COMMAND, less trailing
+//                newlines, as a single word (there is no field splitting);
+//                also expanded in here documents.  A COMMAND made up only of
+//                echo, pwd, and : runs in the shell with stdout sent to an
+//                anonymous file; anything else runs in a child with stdout
+//                read through a pipe straight into a growing buffer.
+//
+// Descriptor redirections such as 2>&1 or 3>>FILE (see fdredir.h) are
+// shielded as words of their own and removed from the arguments of the copy.
+// Those after a subshell's ) are moved into an "exec ... ;" at the start of
+// its body, since the parser takes no words there.
+//
+// After expansion, each argument that contains an unquoted *, ?, or [...]
+// is replaced by the sorted list of pathnames it matches (see pathexp.h),
+// or left as is if it matches none or NOGLOB is set.  shield() marks quoted
+// and backslashed pattern characters as one-byte constructs so that they
+// stay literal.
+
+#include "process.h"
+#include "fdredir.h"
+
+#define SH_ESC   '\001'         // Next byte is a shielded byte ^ 0x80
+#define SH_BEGIN '\002'         // Start of shielded construct
+#define SH_END   '\003'         // End of shielded construct
+#define SH_QUOTE '\004'         // Construct was quoted
+
+// Return a malloc()-ed copy of LINE with every construct shielded
+char *shield (const char *line);
+
+// Return a copy of the stage CMDLIST with its arguments, local values, and
+// redirection filenames expanded, or NULL if there is nothing to expand.
+// Processes started for process substitution keep running until the copy
+// is passed to freeExpanded().
+CMD *expandCMD (const CMD *cmdList);
+
+// Return the descriptor redirections of CMDLIST, a copy returned by
+// expandCMD() or a copy of that whose argv skips its first words (as
+// timeout and argsplit run their commands), and store their number in *N
+// (0 for any other CMD)
+const FdRedir *fdRedirs (const CMD *cmdList, int *n);
+
+// Return true if the stage CMDLIST, before expansion, has any descriptor
+// redirections
+bool hasFdRedirs (const CMD *cmdList);
+
+// Free a copy returned by expandCMD() (NULL is ignored), closing the
+// shell's ends of its substitution pipes and waiting for their processes
+void freeExpanded (CMD *cmdList);
+
+// Tokenize, parse, and execute the command line TEXT and return its status
+int run_text (const char *text);
@@ -0,0 +1,130 @@
+#include "fdredir.h"
+#include "shellstat.h"
+#include <fcntl.h>
+#include <ctype.h>
+
+
+// FUNCTION DECLARATIONS
+// record in save how to put fd back
+static void save_fd(FdSave *save, int fd);
+
+
+int fd_parse(const char *text, FdRedir *r) {
+    int i = 0;
+    while (isdigit((unsigned char) text[i])) {
+        i++;
+    }
+    bool numbered = (i > 0);
+    r->fd = numbered ? atoi(text) : -1;
+    r->from = -1;
+    r->file = NULL;
+
+    char c = text[i];
+    if (c != '<' && c != '>') {
+        return 0;
+    }
+    if (!numbered) {
+        r->fd = (c == '<') ? STDIN_FILENO : STDOUT_FILENO;
+    }
+    i++;
+
+    // [N]>&M, [N]<&M, [N]>&-, [N]<&-
+    if (text[i] == '&') {
+        i++;
+        if (text[i] == '-') {
+            r->op = FD_CLOSE;
+            return i + 1;
+        }
+        if (!isdigit((unsigned char) text[i])) {
+            return 0;
+        }
+        r->op = FD_DUP;
+        r->from = atoi(text + i);
+        while (isdigit((unsigned char) text[i])) {
+            i++;
+        }
+        return i;
+    }
+
+    // N>>FILE, N>FILE, N<FILE
+    if (c == '>' && text[i] == '>') {
+        r->op = FD_APP;
+        return i + 1;
+    }
+    r->op = (c == '>') ? FD_OUT : FD_IN;
+    return i;
+}
+
+
+static void save_fd(FdSave *save, int fd) {
+    if (save->n == save->size) {
+        save->size = save->size ? 2 * save->size : 4;
+        REALLOC(save->fd, save->size);
+        REALLOC(save->copy, save->size);
+    }
+    save->fd[save->n] = fd;
+    save->copy[save->n] = fcntl(fd, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+    save->n++;
+}
+
+
+int fd_apply(const FdRedir *r, int n, FdSave *save) {
+    for (int i = 0; i < n; i++) {
+        if (save != NULL) {
+            save_fd(save, r[i].fd);
+        }
+
+        switch (r[i].op) {
+            case FD_IN:
+            case FD_OUT:
+            case FD_APP:
+            {
+                int flags = (r[i].op == FD_IN) ? O_RDONLY
+                          : (r[i].op == FD_OUT) ? O_RDWR|O_CREAT|O_TRUNC
+                          : O_RDWR|O_CREAT|O_APPEND;
+                int fd = open(r[i].file, flags, S_IRWXU);
+                if (fd < 0) {
+                    int errno2 = errno;
+                    perror("Open error");
+                    return errno2;
+                }
+                stat_add(ST_REDIRS, 1);
+                if (fd != r[i].fd) {
+                    dup2(fd, r[i].fd);
+                    close(fd);
+                }
+                break;
+            }
+
+            case FD_DUP:
+                if (r[i].from != r[i].fd && dup2(r[i].from, r[i].fd) < 0) {
+                    int errno2 = errno;
+                    fprintf(stderr, "%d: %s\n", r[i].from, strerror(errno2));
+                    return errno2;
+                }
+                break;
+
+            case FD_CLOSE:
+                close(r[i].fd);
+                break;
+        }
+    }
+    return 0;
+}
+
+
+void fd_undo(FdSave *save) {
+    for (int i = save->n - 1; i >= 0; i--) {
+        if (save->copy[i] >= 0) {
+            dup2(save->copy[i], save->fd[i]);
+            close(save->copy[i]);
+        }
+        else {
+            close(save->fd[i]);
+        }
+    }
+    free(save->fd);
+    free(save->copy);
+    save->fd = save->copy = NULL;
+    save->n = save->size = 0;
+}
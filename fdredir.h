@@ -0,0 +1,47 @@
+// fdredir.h
+//
+// Redirections of numbered file descriptors, which the grammar in parse.o
+// does not have:
+//
+//   N<FILE   N>FILE   N>>FILE      Open FILE on descriptor N
+//   [N]>&M   [N]<&M                Make N (default 1 or 0) a copy of M
+//   [N]>&-   [N]<&-                Close N
+//
+// shield() (see expand.h) turns each operator into a word of its own, and
+// expandCMD() moves it and its FILE out of the arguments of the stage.  They
+// are applied after the stage's < and > redirections, in order.
+
+#include "process.h"
+
+// lowest descriptor used for saved copies, out of the way of N<FILE
+#define FD_SAVE_MIN 10
+
+// kinds of redirection
+enum { FD_IN, FD_OUT, FD_APP, FD_DUP, FD_CLOSE };
+
+// one redirection
+typedef struct fdRedir {
+    int fd;             // descriptor redirected
+    int op;             // FD_IN, FD_OUT, FD_APP, FD_DUP, or FD_CLOSE
+    int from;           // descriptor copied by FD_DUP
+    char *file;         // file opened by FD_IN, FD_OUT, or FD_APP
+} FdRedir;
+
+// descriptors replaced by fd_apply(), to be put back by fd_undo()
+typedef struct fdSave {
+    int n, size;
+    int *fd;            // descriptor replaced
+    int *copy;          // copy of what it was, or -1 if it was closed
+} FdSave;
+
+// Return the length of the redirection operator at the start of TEXT (0 if
+// none), storing it in *R; *R->file is left NULL
+int fd_parse (const char *text, FdRedir *r);
+
+// Apply the N redirections R to the calling process.  If SAVE is not NULL,
+// record in it what fd_undo() needs to reverse them.  Return 0, or errno
+// after writing a message to stderr.
+int fd_apply (const FdRedir *r, int n, FdSave *save);
+
+// Reverse the redirections recorded in SAVE, last first, and empty it
+void fd_undo (FdSave *save);
@@ -0,0 +1,92 @@
+// herebench
+//
+// Here document expansion throughput in MB/s: expandHere() (see heredoc.h)
+// against the parser's original, linked as old_expandHere() (see the
+// Makefile).  Documents of 256 KB and 8 MB have a $NAME reference every
+// 1000 bytes (sparse) or every 16 bytes (dense); each expansion runs on
+// them for half a second.  The original rebuilds the whole document for
+// each reference, so it is timed only on the 256 KB documents, where the
+// two results are also checked to be the same.
+#include "process.h"
+#include "heredoc.h"
+#include <time.h>
+
+// largest document given to old_expandHere()
+#define OLD_MAX (256 * 1024)
+
+char *old_expandHere (char *text);
+
+
+// FUNCTION DECLARATIONS
+// return the monotonic clock in seconds
+static double now(void);
+// return a malloc()-ed document of SIZE bytes with a reference every GAP
+static char *make_doc(size_t size, int gap);
+// return the MB/s at which EXPAND expands DOC
+static double rate(char *(*expand)(char *), const char *doc);
+
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+static char *make_doc(size_t size, int gap) {
+    static const char *refs[] = {"$HOST", "$PORT", "$USER_NAME", "$UNSET_VAR"};
+    char *doc = malloc(size + 64);
+    size_t n = 0;
+    for (int i = 0; n < size; i++) {
+        const char *ref = refs[i % 4];
+        int fill = gap - strlen(ref) - 1;
+        for (int j = 0; j < fill; j++) {
+            doc[n++] = (j % 64 == 63) ? '\n' : 'a' + j % 26;
+        }
+        n += sprintf(doc + n, "%s ", ref);
+    }
+    doc[n] = '\0';
+    return doc;
+}
+
+
+static double rate(char *(*expand)(char *), const char *doc) {
+    size_t len = strlen(doc);
+    int reps = 0;
+    double start = now(), t;
+    do {
+        char *text = strdup(doc);
+        free(expand(text));
+        reps++;
+    } while ((t = now() - start) < 0.5);
+    return len / 1e6 * reps / t;
+}
+
+
+int main(void) {
+    setenv("HOST", "db01.example.com", 1);
+    setenv("PORT", "5432", 1);
+    setenv("USER_NAME", "deploy", 1);
+    unsetenv("UNSET_VAR");
+
+    size_t sizes[] = {256 * 1024, 8 * 1024 * 1024};
+    int gaps[] = {1000, 16};
+    for (int s = 0; s < 2; s++) {
+        for (int g = 0; g < 2; g++) {
+            char *doc = make_doc(sizes[s], gaps[g]);
+            printf("%5zu KB, a reference every %4d bytes:  expandHere %8.1f MB/s",
+                   sizes[s] / 1024, gaps[g], rate(expandHere, doc));
+            if (sizes[s] <= OLD_MAX) {
+                char *a = expandHere(strdup(doc));
+                char *b = old_expandHere(strdup(doc));
+                printf("  original %8.2f MB/s%s", rate(old_expandHere, doc),
+                       strcmp(a, b) == 0 ? "" : "  (results differ)");
+                free(a);
+                free(b);
+            }
+            printf("\n");
+            free(doc);
+        }
+    }
+    return 0;
+}
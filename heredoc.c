@@ -0,0 +1,424 @@
+#include "heredoc.h"
+#include "param.h"
+#include <ctype.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// bytes read at once from a regular file
+#define HERE_BLOCK (64 * 1024)
+
+extern char **environ;
+
+
+// one change to the text: SKIP bytes at offset AT become the LENGTH bytes
+// at VALUE, or at OFFSET in scratch if VALUE is NULL
+typedef struct edit {
+    size_t at, skip;
+    const char *value;
+    size_t offset, length;
+} Edit;
+
+// environment variable in the lookup table
+typedef struct var {
+    const char *name;           // NAME=VALUE in environ (NULL if free)
+    size_t length;              // length of NAME
+} Var;
+
+// script text that here documents are read from instead of stdin (see
+// here_source()): the next line is at *srcNext, and the text ends at srcEnd
+static const char **srcNext = NULL;
+static const char *srcEnd;
+static bool srcExpand;          // expand them as they are read
+
+// 1 for bytes that can start a variable name, 2 for those that can follow
+static unsigned char nameChar[256];
+
+// values built by ${...}, reused by each document
+static ParamBuf scratch = {NULL, 0, 0};
+
+
+// FUNCTION DECLARATIONS
+// return index of first $ or \ in text[i..len), or len
+static size_t (*next_escape)(const char *text, size_t i, size_t len);
+static size_t next_escape_scalar(const char *text, size_t i, size_t len);
+#if defined(__x86_64__) || defined(__i386__)
+static size_t next_escape_sse2(const char *text, size_t i, size_t len);
+static size_t next_escape_avx2(const char *text, size_t i, size_t len);
+#endif
+// fill nameChar[] and pick next_escape()
+static void heredoc_init(void);
+// return true if the n-byte line is the terminator word (of length wordLen)
+static bool is_end(const char *line, size_t n, const char *word, size_t wordLen);
+// read a document from a regular stdin in blocks, then lseek() back
+static char *here_blocks(const char *word);
+// read a document from stdin a line at a time
+static char *here_lines(const char *word);
+// read a document from the script text at *srcNext
+static char *here_text(const char *word);
+// return text with variables and escapes expanded, free()ing it if changed
+static char *expand_doc(char *text);
+// return a hash of the n bytes at s
+static size_t hash_name(const char *s, size_t n);
+// fill *table (of *size entries) from environ
+static void vars_load(Var **table, size_t *size);
+// return the value of the n-byte name at s in table, or "" if unset
+static const char *vars_find(const Var *table, size_t size, const char *s, size_t n);
+
+
+static void heredoc_init(void) {
+    for (int c = 0; c < 256; c++) {
+        if (isalpha(c) || c == '_') {
+            nameChar[c] = 3;
+        }
+        else if (isdigit(c)) {
+            nameChar[c] = 2;
+        }
+    }
+
+    next_escape = next_escape_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        next_escape = next_escape_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        next_escape = next_escape_sse2;
+    }
+#endif
+}
+
+
+static size_t next_escape_scalar(const char *text, size_t i, size_t len) {
+    while (i < len && text[i] != '$' && text[i] != '\\') {
+        i++;
+    }
+    return i;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static size_t next_escape_sse2(const char *text, size_t i, size_t len) {
+    const __m128i dollar = _mm_set1_epi8('$');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for ( ; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (text + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, dollar), _mm_cmpeq_epi8(v, backslash));
+        unsigned bits = _mm_movemask_epi8(m);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+    return next_escape_scalar(text, i, len);
+}
+
+
+__attribute__((target("avx2")))
+static size_t next_escape_avx2(const char *text, size_t i, size_t len) {
+    const __m256i dollar = _mm256_set1_epi8('$');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    for ( ; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (text + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, dollar),
+                                    _mm256_cmpeq_epi8(v, backslash));
+        unsigned bits = _mm256_movemask_epi8(m);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+    return next_escape_sse2(text, i, len);
+}
+#endif
+
+
+static size_t hash_name(const char *s, size_t n) {
+    size_t h = 5381;
+    for (size_t i = 0; i < n; i++) {
+        h = h * 33 + (unsigned char) s[i];
+    }
+    return h;
+}
+
+
+static void vars_load(Var **table, size_t *size) {
+    size_t n = 0;
+    while (environ[n] != NULL) {
+        n++;
+    }
+    *size = 16;
+    while (*size < 2 * n) {
+        *size *= 2;
+    }
+    *table = calloc(*size, sizeof(Var));
+
+    // open addressing; the first of duplicate names wins, as for getenv()
+    for (size_t i = 0; i < n; i++) {
+        const char *eq = strchr(environ[i], '=');
+        if (eq == NULL) {
+            continue;
+        }
+        size_t length = eq - environ[i];
+        size_t h = hash_name(environ[i], length) & (*size - 1);
+        while ((*table)[h].name != NULL && ((*table)[h].length != length
+                    || strncmp((*table)[h].name, environ[i], length) != 0)) {
+            h = (h + 1) & (*size - 1);
+        }
+        if ((*table)[h].name == NULL) {
+            (*table)[h].name = environ[i];
+            (*table)[h].length = length;
+        }
+    }
+}
+
+
+static const char *vars_find(const Var *table, size_t size, const char *s, size_t n) {
+    for (size_t h = hash_name(s, n) & (size - 1); table[h].name != NULL; h = (h + 1) & (size - 1)) {
+        if (table[h].length == n && memcmp(table[h].name, s, n) == 0) {
+            return table[h].name + n + 1;
+        }
+    }
+    return "";
+}
+
+
+static bool is_end(const char *line, size_t n, const char *word, size_t wordLen) {
+    return n >= wordLen && memcmp(line, word, wordLen) == 0
+        && (n == wordLen || line[wordLen] == '\n' || line[wordLen] == '\0');
+}
+
+
+static char *here_blocks(const char *word) {
+    size_t wordLen = strlen(word);
+    size_t size = 2 * HERE_BLOCK, len = 0;
+    size_t scan = 0;                    // start of first unchecked line
+    char *text = malloc(size);
+    bool eof = false;
+
+    for (;;) {
+        char *nl = memchr(text + scan, '\n', len - scan);
+        if (nl != NULL) {
+            size_t end = nl - text + 1;
+            if (is_end(text + scan, end - scan, word, wordLen)) {
+                // give back what follows the terminator
+                lseek(STDIN_FILENO, (off_t) end - (off_t) len, SEEK_CUR);
+                text[scan] = '\0';
+                return text;
+            }
+            scan = end;
+            continue;
+        }
+        if (eof) {
+            break;
+        }
+        if (len + HERE_BLOCK + 2 > size) {
+            size *= 2;
+            REALLOC(text, size);
+        }
+        ssize_t n = read(STDIN_FILENO, text + len, HERE_BLOCK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            eof = true;
+        }
+        else {
+            len += n;
+        }
+    }
+
+    // a last line without a newline ends the document or gets one
+    if (scan < len && is_end(text + scan, len - scan, word, wordLen)) {
+        len = scan;
+    }
+    else if (scan < len) {
+        text[len++] = '\n';
+    }
+    text[len] = '\0';
+    return text;
+}
+
+
+static char *here_lines(const char *word) {
+    size_t wordLen = strlen(word);
+    size_t size = 256, len = 0;
+    char *text = malloc(size);
+    char *line = NULL;
+    size_t nLine = 0;
+    ssize_t n;
+
+    while ((n = getline(&line, &nLine, stdin)) > 0) {
+        if (is_end(line, n, word, wordLen)) {
+            break;
+        }
+        // a last line without a newline gets one
+        size_t need = len + n + 2;
+        if (need > size) {
+            while (size < need) {
+                size *= 2;
+            }
+            REALLOC(text, size);
+        }
+        memcpy(text + len, line, n);
+        len += n;
+        if (line[n-1] != '\n') {
+            text[len++] = '\n';
+        }
+    }
+    text[len] = '\0';
+    free(line);
+    return text;
+}
+
+
+static char *here_text(const char *word) {
+    size_t wordLen = strlen(word);
+    const char *start = *srcNext;
+    const char *s = start;
+    const char *end = start;            // end of the document
+
+    while (s < srcEnd) {
+        const char *nl = memchr(s, '\n', srcEnd - s);
+        const char *next = nl ? nl + 1 : srcEnd;
+        if (is_end(s, next - s, word, wordLen)) {
+            s = next;
+            break;
+        }
+        end = s = next;
+    }
+    *srcNext = s;
+
+    // a last line without a newline gets one
+    size_t len = end - start;
+    char *text = malloc(len + 2);
+    memcpy(text, start, len);
+    if (len > 0 && text[len-1] != '\n') {
+        text[len++] = '\n';
+    }
+    text[len] = '\0';
+    return text;
+}
+
+
+void here_source(const char **next, const char *end, bool expand) {
+    srcNext = next;
+    srcEnd = end;
+    srcExpand = expand;
+}
+
+
+char *getHere(char *word) {
+    struct stat st;
+    char *text;
+    if (srcNext != NULL) {
+        text = here_text(word);
+    }
+    else if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)
+            && lseek(STDIN_FILENO, 0, SEEK_CUR) >= 0) {
+        text = here_blocks(word);
+    }
+    else {
+        text = here_lines(word);
+    }
+    free(word);
+    return text;
+}
+
+
+char *expandHere(char *text) {
+    return (srcNext != NULL && !srcExpand) ? text : expand_doc(text);
+}
+
+
+char *here_expand(const char *text) {
+    return expand_doc(strdup(text));
+}
+
+
+static char *expand_doc(char *text) {
+    if (next_escape == NULL) {
+        heredoc_init();
+    }
+
+    size_t len = strlen(text);
+    Edit *edits = NULL;
+    int nEdits = 0, size = 0;
+    Var *vars = NULL;
+    size_t nVars = 0;
+    scratch.n = 0;
+
+    // find the edits and the length of the result
+    size_t out = len;
+    for (size_t i = next_escape(text, 0, len); i < len; i = next_escape(text, i, len)) {
+        Edit e = {i, 0, NULL, 0, 0};
+        unsigned char c = text[i+1];
+        if (text[i] == '\\' && (c == '\\' || c == '$')) {
+            e.skip = 2;
+            e.value = text + i + 1;
+            e.length = 1;
+        }
+        else if (text[i] == '$' && (nameChar[c] & 1)) {
+            size_t n = 1;
+            while (nameChar[(unsigned char) text[i+1+n]] & 2) {
+                n++;
+            }
+            if (vars == NULL) {
+                vars_load(&vars, &nVars);
+            }
+            e.skip = n + 1;
+            e.value = vars_find(vars, nVars, text + i + 1, n);
+            e.length = strlen(e.value);
+        }
+        else if (text[i] == '$' && c == '{' && (e.skip = param_length(text + i)) > 0) {
+            size_t before = scratch.n;
+            unsigned long assigned = param_assigned();
+            if (param_expand(text + i, e.skip, &scratch, &e.value, &e.length) < 0) {
+                i += e.skip;
+                continue;
+            }
+            if (scratch.n > before) {
+                e.value = NULL;
+                e.offset = before;
+            }
+            // ${NAME:=WORD} changed the environment the table was made from
+            if (param_assigned() != assigned) {
+                free(vars);
+                vars = NULL;
+            }
+        }
+        else {
+            i++;
+            continue;
+        }
+        if (nEdits == size) {
+            size = size ? 2 * size : 64;
+            REALLOC(edits, size);
+        }
+        edits[nEdits++] = e;
+        out += e.length - e.skip;
+        i += e.skip;
+    }
+    if (nEdits == 0) {
+        return text;
+    }
+
+    // copy the text between edits and the values in bulk
+    char *result = malloc(out + 1);
+    char *dst = result;
+    size_t from = 0;
+    for (int k = 0; k < nEdits; k++) {
+        memcpy(dst, text + from, edits[k].at - from);
+        dst += edits[k].at - from;
+        memcpy(dst, edits[k].value ? edits[k].value : scratch.s + edits[k].offset, edits[k].length);
+        dst += edits[k].length;
+        from = edits[k].at + edits[k].skip;
+    }
+    memcpy(dst, text + from, len - from);
+    result[out] = '\0';
+
+    free(vars);
+    free(edits);
+    free(text);
+    return result;
+}
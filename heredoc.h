@@ -0,0 +1,42 @@
+// heredoc.h
+//
+// Here documents.  These replace the parser's getHere() and expandHere(),
+// which are weak symbols in the copy of parse.o that is linked (see the
+// Makefile), with versions that take time linear in the size of the text.
+//
+// getHere() appends lines to a doubling buffer rather than rebuilding the
+// text for each line.  When stdin is a regular file it reads 64 KB at a time
+// and lseek()s back over what follows the document, instead of reading a
+// byte at a time through the unbuffered stdin.
+//
+// expandHere() finds the bytes that matter ($ and \) 16 (SSE2) or 32 (AVX2)
+// bytes at a time, with a scalar fallback on other machines, and looks up
+// each $NAME in a hash table of the environment built once per document.
+// It sizes the result exactly before copying the text between references in
+// bulk.  Both behave as the originals:
+//
+//   \\  and  \$      become  \  and  $
+//   $NAME            becomes the value of NAME ("" if unset), where NAME is
+//                      a letter or _ followed by letters, digits, and _
+//
+// and every other byte is copied unchanged, except that ${...} becomes its
+// expansion (see param.h), left as is if malformed.
+
+#include "process.h"
+
+// Read the lines of a here document from stdin up to a line that is WORD
+// (or end of file) and return them as a malloc()-ed string; free() WORD
+char *getHere (char *word);
+
+// Return TEXT with variables and escapes expanded as above; TEXT is free()d
+// if the result is a different string
+char *expandHere (char *text);
+
+// Until called again with NEXT == NULL, have getHere() read the lines of
+// here documents from the text at *NEXT (which it advances) up to END rather
+// than from stdin, and unless EXPAND have expandHere() leave them as they
+// are, so that a script can be parsed ahead of running it (see script.h)
+void here_source (const char **next, const char *end, bool expand);
+
+// Return a malloc()-ed copy of the here document TEXT expanded as above
+char *here_expand (const char *text);
@@ -0,0 +1,476 @@
+#include "jobs.h"
+#include "shellstat.h"
+#include <termios.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+
+// stopped or background job
+typedef struct job {
+    int pgid;           // process group (0 = free slot)
+    bool stopped;       // stopped rather than running
+    char *name;         // command text
+} Job;
+
+static Job *jobs = NULL;            // job %N is jobs[N-1]
+static int nJobs = 0;
+
+static bool control = false;        // job control enabled
+static int shell_pid = 0;           // the shell itself (0 = job_init() not run)
+static int shell_pgid = 0;          // its process group
+static struct termios shell_modes;  // its terminal modes
+
+static int job_pgid = 0;            // process group of the current job (0 = none)
+static bool job_fg = false;         // current job has the terminal
+static bool job_stopped = false;    // current job stopped
+
+static struct timespec deadline;    // when to signal (tv_sec = 0: none)
+static int deadline_sig;            // signal sent then
+static long kill_after = 0;         // ns from then to SIGKILL (0 = never)
+static int expired = 0;             // see job_expired()
+
+
+// FUNCTION DECLARATIONS
+// return true if the caller is the shell itself
+static bool in_shell(void);
+// write a description of cmd to f
+static void describe(FILE *f, const CMD *cmd);
+// record process group pgid as job cmd; return its number
+static int add_job(int pgid, const CMD *cmd, bool stopped);
+// free the slots of jobs whose processes are all gone
+static void prune_jobs(void);
+// return the number of the job named by argv[1] (%N, N, or the latest), or 0
+static int find_job(const CMD *cmdList, const char *who);
+// give the terminal back to the shell, restoring its modes if restore
+static void take_terminal(bool restore);
+// job_wait() for process pid while a deadline is set; return as wait4()
+static int wait_deadline(int pid, int *status, int options, struct rusage *usage);
+// set the deadline ns nanoseconds from now
+static void set_deadline(long ns);
+// arm timerfd fd for the next step of the deadline; return false if none
+static bool arm_deadline(int fd);
+
+
+static bool in_shell(void) {
+    return shell_pid != 0 && getpid() == shell_pid;
+}
+
+
+void job_init(void) {
+    shell_pid = getpid();
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    if (!isatty(STDIN_FILENO)) {
+        return;
+    }
+
+    // wait until started in the foreground
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+        kill(-shell_pgid, SIGTTIN);
+    }
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    // lead a process group of our own (fails harmlessly for a session leader)
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    tcsetpgrp(STDIN_FILENO, shell_pgid);
+    tcgetattr(STDIN_FILENO, &shell_modes);
+    control = true;
+}
+
+
+bool job_shell(void) {
+    return in_shell();
+}
+
+
+bool job_control(void) {
+    return control;
+}
+
+
+void job_signals(void) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    if (control) {
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+}
+
+
+int job_fork(bool fg) {
+    bool from_shell = in_shell();
+    stat_add(ST_FORKS, 1);
+    int pid = fork();
+
+    // descendants of the shell's children stay in the group they inherit
+    if (!from_shell || pid < 0) {
+        if (pid == 0) {
+            // dispositions were already reset in the shell's child
+            return 0;
+        }
+        return pid;
+    }
+
+    // both sides set the group, so neither can exec or wait first; a job
+    // with a deadline gets a group to signal even without job control
+    bool grouped = control || job_limited();
+    if (pid > 0) {
+        if (grouped) {
+            if (job_pgid == 0) {
+                job_pgid = pid;
+                job_fg = fg;
+                job_stopped = false;
+            }
+            setpgid(pid, job_pgid);
+            if (control && job_fg) {
+                tcsetpgrp(STDIN_FILENO, job_pgid);
+            }
+        }
+        return pid;
+    }
+
+    if (grouped) {
+        int pgid = job_pgid ? job_pgid : getpid();
+        setpgid(0, pgid);
+        if (control && (job_pgid ? job_fg : fg)) {
+            tcsetpgrp(STDIN_FILENO, pgid);
+        }
+    }
+    job_signals();
+    return 0;
+}
+
+
+int job_wait(int pid, int *status, struct rusage *usage, const CMD *cmd) {
+    // only the shell sees stops; other waiters are stopped along with the job
+    int options = (control && in_shell()) ? WUNTRACED : 0;
+    int r;
+    if (deadline.tv_sec != 0) {
+        r = wait_deadline(pid, status, options, usage);
+    }
+    else {
+        while ((r = wait4(pid, status, options, usage)) < 0 && errno == EINTR)
+            ;
+    }
+    if (r < 0 || !WIFSTOPPED(*status)) {
+        return r;
+    }
+
+    // record once, although each stage of a pipeline reports the stop
+    if (!job_stopped) {
+        job_stopped = true;
+        int n = add_job(job_pgid, cmd, true);
+        fprintf(stderr, "\n[%d]  Stopped\t\t%s\n", n, jobs[n-1].name);
+    }
+    *status = (128 + WSTOPSIG(*status)) << 8;
+    return r;
+}
+
+
+bool job_suspended(void) {
+    return job_stopped;
+}
+
+
+void job_deadline(long ns, int sig, long kill_ns) {
+    expired = 0;
+    if (ns <= 0) {
+        deadline.tv_sec = deadline.tv_nsec = 0;
+        return;
+    }
+    set_deadline(ns);
+    deadline_sig = sig;
+    kill_after = kill_ns;
+}
+
+
+static void set_deadline(long ns) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ns / 1000000000L;
+    deadline.tv_nsec += ns % 1000000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+}
+
+
+int job_expired(void) {
+    return expired;
+}
+
+
+bool job_limited(void) {
+    return deadline.tv_sec != 0;
+}
+
+
+static bool arm_deadline(int fd) {
+    if (expired == 1 && kill_after <= 0) {
+        return false;
+    }
+    struct itimerspec when = {{0, 0}, deadline};
+    return timerfd_settime(fd, TFD_TIMER_ABSTIME, &when, NULL) == 0;
+}
+
+
+static int wait_deadline(int pid, int *status, int options, struct rusage *usage) {
+    // the whole job if it has a group of its own, else the process, which
+    // is sent what earlier processes of the job already were
+    int target = (in_shell() && job_pgid != 0) ? -job_pgid : pid;
+    if (target == pid && expired > 0) {
+        kill(pid, deadline_sig);
+        kill(pid, expired == 2 ? SIGKILL : SIGCONT);
+    }
+
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    bool armed = (expired < 2 && pidfd >= 0 && timer >= 0 && arm_deadline(timer));
+
+    while (armed) {
+        struct pollfd fds[2] = {{pidfd, POLLIN, 0}, {timer, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        uint64_t ticks;
+        if (read(timer, &ticks, sizeof(ticks)) < 0) {
+            continue;
+        }
+        if (expired == 0) {
+            kill(target, deadline_sig);
+            if (deadline_sig != SIGKILL && deadline_sig != SIGCONT) {
+                kill(target, SIGCONT);
+            }
+            expired = (deadline_sig == SIGKILL) ? 2 : 1;
+            // SIGKILL follows kill_after ns after the first signal
+            if (expired == 1 && kill_after > 0) {
+                set_deadline(kill_after);
+            }
+            armed = (expired == 1 && arm_deadline(timer));
+        }
+        else {
+            kill(target, SIGKILL);
+            expired = 2;
+            armed = false;
+        }
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+    if (timer >= 0) {
+        close(timer);
+    }
+
+    int r;
+    while ((r = wait4(pid, status, options, usage)) < 0 && errno == EINTR)
+        ;
+    return r;
+}
+
+
+void job_done(void) {
+    if (!in_shell()) {
+        return;
+    }
+    if (control && job_fg) {
+        take_terminal(job_stopped);
+    }
+    job_pgid = 0;
+    job_fg = false;
+    job_stopped = false;
+}
+
+
+void job_background(int pid, const CMD *cmd) {
+    if (!in_shell()) {
+        return;
+    }
+    if (control) {
+        add_job(pid, cmd, false);
+    }
+    job_pgid = 0;
+    job_fg = false;
+}
+
+
+static void describe(FILE *f, const CMD *cmd) {
+    if (cmd == NULL) {
+        return;
+    }
+    switch (cmd->type) {
+        case SIMPLE:
+            for (int i = 0; i < cmd->argc; i++) {
+                fprintf(f, (i > 0) ? " %s" : "%s", cmd->argv[i]);
+            }
+            break;
+        case SUBCMD:
+            fputs("( ", f);
+            describe(f, cmd->left);
+            fputs(" )", f);
+            break;
+        default:
+            describe(f, cmd->left);
+            fputs(cmd->type == PIPE ? " | " : cmd->type == SEP_AND ? " && "
+                  : cmd->type == SEP_OR ? " || " : cmd->type == SEP_BG ? " & " : " ; ", f);
+            describe(f, cmd->right);
+            break;
+    }
+}
+
+
+static int add_job(int pgid, const CMD *cmd, bool stopped) {
+    prune_jobs();
+    int i = 0;
+    while (i < nJobs && jobs[i].pgid != 0 && jobs[i].pgid != pgid) {
+        i++;
+    }
+    if (i == nJobs) {
+        REALLOC(jobs, ++nJobs);
+        jobs[i].pgid = 0;
+        jobs[i].name = NULL;
+    }
+    if (jobs[i].pgid == 0) {
+        size_t size;
+        FILE *f = open_memstream(&jobs[i].name, &size);
+        describe(f, cmd);
+        fclose(f);
+    }
+    jobs[i].pgid = pgid;
+    jobs[i].stopped = stopped;
+    return i + 1;
+}
+
+
+static void prune_jobs(void) {
+    for (int i = 0; i < nJobs; i++) {
+        if (jobs[i].pgid != 0 && kill(-jobs[i].pgid, 0) < 0 && errno == ESRCH) {
+            jobs[i].pgid = 0;
+            free(jobs[i].name);
+            jobs[i].name = NULL;
+        }
+    }
+    while (nJobs > 0 && jobs[nJobs-1].pgid == 0) {
+        nJobs--;
+    }
+}
+
+
+static int find_job(const CMD *cmdList, const char *who) {
+    if (!control) {
+        fprintf(stderr, "%s: no job control\n", who);
+        return 0;
+    }
+    prune_jobs();
+
+    int n = nJobs;
+    if (cmdList->argc > 1) {
+        const char *s = cmdList->argv[1];
+        n = atoi(s[0] == '%' ? s + 1 : s);
+    }
+    if (n < 1 || n > nJobs || jobs[n-1].pgid == 0) {
+        fprintf(stderr, "%s: no such job\n", who);
+        return 0;
+    }
+    return n;
+}
+
+
+static void take_terminal(bool restore) {
+    tcsetpgrp(STDIN_FILENO, shell_pgid);
+    if (restore) {
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_modes);
+    }
+}
+
+
+int jobs_command(const CMD *cmdList) {
+    prune_jobs();
+    for (int i = 0; i < nJobs; i++) {
+        if (jobs[i].pgid != 0) {
+            printf("[%d]  %s\t\t%s\n", i + 1,
+                   jobs[i].stopped ? "Stopped" : "Running", jobs[i].name);
+        }
+    }
+    fflush(stdout);
+    return 0;
+}
+
+
+int fg_command(const CMD *cmdList) {
+    int n = find_job(cmdList, "fg");
+    if (n == 0) {
+        return 1;
+    }
+    Job *job = &jobs[n-1];
+    printf("%s\n", job->name);
+    fflush(stdout);
+
+    tcsetpgrp(STDIN_FILENO, job->pgid);
+    if (job->stopped) {
+        kill(-job->pgid, SIGCONT);
+        job->stopped = false;
+    }
+
+    // wait for the whole group, or until it stops again
+    int ret_val = 0;
+    bool stopped = false;
+    for (;;) {
+        int status;
+        int r = waitpid(-job->pgid, &status, WUNTRACED);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (WIFSTOPPED(status)) {
+            stopped = true;
+            ret_val = 128 + WSTOPSIG(status);
+            break;
+        }
+        ret_val = STATUS(status);
+    }
+    take_terminal(true);
+
+    job = &jobs[n-1];
+    if (stopped) {
+        job->stopped = true;
+        fprintf(stderr, "\n[%d]  Stopped\t\t%s\n", n, job->name);
+    }
+    else {
+        prune_jobs();
+    }
+    return ret_val;
+}
+
+
+int bg_command(const CMD *cmdList) {
+    int n = find_job(cmdList, "bg");
+    if (n == 0) {
+        return 1;
+    }
+    Job *job = &jobs[n-1];
+    if (kill(-job->pgid, SIGCONT) < 0) {
+        int errno2 = errno;
+        perror("bg");
+        return errno2;
+    }
+    job->stopped = false;
+    printf("[%d] %s &\n", n, job->name);
+    fflush(stdout);
+    return 0;
+}
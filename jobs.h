@@ -0,0 +1,75 @@
+// jobs.h
+//
+// Signal dispositions and job control.  job_init() installs the shell's
+// dispositions once at startup (SIGINT and SIGQUIT are ignored, and with job
+// control SIGTSTP, SIGTTIN, and SIGTTOU as well), so no per-command signal()
+// calls are needed; each child restores the defaults after fork().
+//
+// Job control is enabled when stdin is a terminal.  Each command that the
+// shell itself forks (a simple command, a pipeline, a subshell, or a
+// background command) then runs in its own process group, with every stage
+// of a pipeline in the group of the first.  A foreground job is given the
+// terminal with tcsetpgrp(), which the shell takes back when the job exits
+// or stops (^Z).  Stopped and background jobs are listed by the built-in
+// "jobs" and resumed by "fg [%N]" and "bg [%N]".
+
+#include "process.h"
+#include <sys/resource.h>
+
+// Install signal dispositions and, if stdin is a terminal, enable job control
+void job_init (void);
+
+// Fork a process of the current job (in the foreground if FG); return as
+// fork().  In the shell itself, the first such fork of a job starts a new
+// process group.
+int job_fork (bool fg);
+
+// Return true if the caller is the shell itself rather than one of its
+// children
+bool job_shell (void);
+
+// Return true if job control is enabled (stdin is a terminal)
+bool job_control (void);
+
+// In a child, restore the default dispositions of the signals the shell
+// ignores
+void job_signals (void);
+
+// Wait for process PID of the current job, storing its status in *STATUS and
+// its resource usage in *USAGE (unless NULL).  If it stops, record the job
+// as CMD and store the status of a process killed by the stop signal.  If
+// the job has a deadline (see job_deadline()), enforce it meanwhile.
+// Return PID, or -1 on error.
+int job_wait (int pid, int *status, struct rusage *usage, const CMD *cmd);
+
+// Return true if the current job has stopped, so that no more of its
+// processes should be started
+bool job_suspended (void);
+
+// Give the waits of the jobs that follow a deadline NS nanoseconds from now,
+// when job_wait() sends SIG (and SIGCONT) to the job's process group, and
+// SIGKILL KILL_NS later unless KILL_NS is 0.  The shell puts such jobs in a
+// group of their own even without job control; in its children, each
+// process waited for is signaled instead.  Waiting uses a pidfd and a timerfd, so there is no
+// polling.  NS = 0 removes the deadline.
+void job_deadline (long ns, int sig, long kill_ns);
+
+// Return 0 if the current deadline has not expired, 1 if SIG was sent, or
+// 2 if SIGKILL was sent as well
+int job_expired (void);
+
+// Return true if the jobs that follow have a deadline (so they must be
+// forked by the shell itself, whose waits enforce it)
+bool job_limited (void);
+
+// In the shell, end the current job: take back the terminal and start a new
+// process group with the next job_fork()
+void job_done (void);
+
+// Record background process PID, just forked with job_fork(false), as CMD
+void job_background (int pid, const CMD *cmd);
+
+// Built-ins jobs, fg [%N], and bg [%N]; return status
+int jobs_command (const CMD *cmdList);
+int fg_command (const CMD *cmdList);
+int bg_command (const CMD *cmdList);
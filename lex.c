@@ -0,0 +1,331 @@
+#include "lex.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+// operator text indexed by token type
+static const char *opText[] = {
+    [RED_IN] = "<",   [RED_IN_HERE] = "<<",
+    [RED_OUT] = ">",  [RED_OUT_APP] = ">>",  [RED_OUT_ERR] = "&>",
+    [RED_ERR] = "2>", [RED_ERR_APP] = "2>>",
+    [PIPE] = "|",     [SEP_AND] = "&&",      [SEP_OR] = "||",
+    [SEP_END] = ";",  [SEP_BG] = "&",
+    [PAR_LEFT] = "(", [PAR_RIGHT] = ")",
+};
+
+// bytes that end or change the meaning of a run of word characters:
+// whitespace, METACHAR, quotes, and backslash
+static unsigned char special[256];
+
+
+// FUNCTION DECLARATIONS
+// return index of first special byte in line[i..len), or len
+static size_t (*next_special)(const char *line, size_t i, size_t len);
+static size_t next_special_scalar(const char *line, size_t i, size_t len);
+#if defined(__x86_64__) || defined(__i386__)
+static size_t next_special_sse2(const char *line, size_t i, size_t len);
+static size_t next_special_avx2(const char *line, size_t i, size_t len);
+#endif
+// fill special[] and pick next_special()
+static void lex_init(void);
+// append token to out
+static void push(LexBuf *out, size_t offset, size_t length, int type, int quoted);
+
+
+static void lex_init(void) {
+    for (const char *s = " \t\n\v\f\r" METACHAR "'\"\\"; *s; s++) {
+        special[(unsigned char) *s] = 1;
+    }
+
+    next_special = next_special_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        next_special = next_special_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        next_special = next_special_sse2;
+    }
+#endif
+}
+
+
+static size_t next_special_scalar(const char *line, size_t i, size_t len) {
+    while (i < len && !special[(unsigned char) line[i]]) {
+        i++;
+    }
+    return i;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static size_t next_special_sse2(const char *line, size_t i, size_t len) {
+    const __m128i ws_bias = _mm_set1_epi8((char) (128 + '\t'));
+    const __m128i ws_span = _mm_set1_epi8((char) (5 - 128));
+    for ( ; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (line + i));
+        // \t, \n, \v, \f, \r: unsigned (v - '\t') < 5
+        __m128i m = _mm_cmplt_epi8(_mm_sub_epi8(v, ws_bias), ws_span);
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        unsigned bits = _mm_movemask_epi8(m);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+    return next_special_scalar(line, i, len);
+}
+
+
+__attribute__((target("avx2")))
+static size_t next_special_avx2(const char *line, size_t i, size_t len) {
+    const __m256i ws_bias = _mm256_set1_epi8((char) (128 + '\t'));
+    const __m256i ws_span = _mm256_set1_epi8((char) (5 - 128));
+    for ( ; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (line + i));
+        __m256i m = _mm256_cmpgt_epi8(ws_span, _mm256_sub_epi8(v, ws_bias));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        unsigned bits = _mm256_movemask_epi8(m);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+    return next_special_sse2(line, i, len);
+}
+#endif
+
+
+int lex(const char *line, size_t len, LexBuf *out) {
+    if (next_special == NULL) {
+        lex_init();
+    }
+
+    int first = out->n;
+    size_t i = 0;
+    for ( ; ; ) {
+        // skip whitespace
+        while (i < len && special[(unsigned char) line[i]] && strchr(" \t\n\v\f\r", line[i])) {
+            i++;
+        }
+        if (i >= len || line[i] == '#') {
+            break;
+        }
+
+        char c = line[i];
+        char d = (i + 1 < len) ? line[i+1] : '\0';
+        switch (c) {
+            case '<':
+                push(out, i, d == '<' ? 2 : 1, d == '<' ? RED_IN_HERE : RED_IN, 0);
+                i += (d == '<') ? 2 : 1;
+                continue;
+            case '>':
+                push(out, i, d == '>' ? 2 : 1, d == '>' ? RED_OUT_APP : RED_OUT, 0);
+                i += (d == '>') ? 2 : 1;
+                continue;
+            case '&':
+                if (d == '&' || d == '>') {
+                    push(out, i, 2, d == '&' ? SEP_AND : RED_OUT_ERR, 0);
+                    i += 2;
+                }
+                else {
+                    push(out, i++, 1, SEP_BG, 0);
+                }
+                continue;
+            case '|':
+                push(out, i, d == '|' ? 2 : 1, d == '|' ? SEP_OR : PIPE, 0);
+                i += (d == '|') ? 2 : 1;
+                continue;
+            case ';':
+                push(out, i++, 1, SEP_END, 0);
+                continue;
+            case '(':
+                push(out, i++, 1, PAR_LEFT, 0);
+                continue;
+            case ')':
+                push(out, i++, 1, PAR_RIGHT, 0);
+                continue;
+            case '2':
+                if (d == '>') {
+                    bool app = (i + 2 < len && line[i+2] == '>');
+                    push(out, i, app ? 3 : 2, app ? RED_ERR_APP : RED_ERR, 0);
+                    i += app ? 3 : 2;
+                    continue;
+                }
+                break;
+            default:
+                break;
+        }
+
+        // SIMPLE: runs of word bytes, quoted strings, and escapes up to
+        // unquoted whitespace or a metacharacter
+        size_t start = i;
+        int quoted = 0;
+        for ( ; ; ) {
+            i = next_special(line, i, len);
+            if (i >= len) {
+                break;
+            }
+            c = line[i];
+            if (c == '\\') {
+                // a backslash before newline or at the end is literal
+                if (i + 1 >= len || line[i+1] == '\n') {
+                    i++;
+                }
+                else {
+                    quoted = 1;
+                    i += 2;
+                }
+            }
+            else if (c == '\'') {
+                const char *q = memchr(line + i + 1, '\'', len - i - 1);
+                if (q == NULL) {
+                    fprintf(stderr, "Unterminated string\n");
+                    out->n = first;
+                    return -1;
+                }
+                quoted = 1;
+                i = q - line + 1;
+            }
+            else if (c == '"') {
+                size_t j = i + 1;
+                for ( ; ; ) {
+                    const char *q = memchr(line + j, '"', len - j);
+                    if (q == NULL) {
+                        fprintf(stderr, "Unterminated string\n");
+                        out->n = first;
+                        return -1;
+                    }
+                    // count the backslashes before it
+                    size_t k = q - line;
+                    size_t nb = 0;
+                    while (k - nb > i + 1 && line[k - nb - 1] == '\\') {
+                        nb++;
+                    }
+                    j = k + 1;
+                    if (nb % 2 == 0) {
+                        break;
+                    }
+                }
+                quoted = 1;
+                i = j;
+            }
+            else {
+                break;
+            }
+        }
+        push(out, start, i - start, SIMPLE, quoted);
+    }
+    return out->n - first;
+}
+
+
+static void push(LexBuf *out, size_t offset, size_t length, int type, int quoted) {
+    if (out->n == out->size) {
+        out->size = out->size ? 2 * out->size : 64;
+        REALLOC(out->tok, out->size);
+    }
+    Lexeme *t = &out->tok[out->n++];
+    t->offset = offset;
+    t->length = length;
+    t->type = type;
+    t->quoted = quoted;
+}
+
+
+size_t lexText(const char *line, const Lexeme *t, char *dst) {
+    const char *s = line + t->offset;
+    const char *end = s + t->length;
+    if (t->type != SIMPLE) {
+        size_t n = strlen(opText[t->type]);
+        memcpy(dst, opText[t->type], n + 1);
+        return n;
+    }
+    if (!t->quoted) {
+        memcpy(dst, s, t->length);
+        dst[t->length] = '\0';
+        return t->length;
+    }
+
+    char *d = dst;
+    while (s < end) {
+        if (*s == '\\') {
+            if (s + 1 < end) {
+                s++;
+            }
+            *d++ = *s++;
+        }
+        else if (*s == '\'') {
+            const char *q = memchr(s + 1, '\'', end - s - 1);
+            memcpy(d, s + 1, q - s - 1);
+            d += q - s - 1;
+            s = q + 1;
+        }
+        else if (*s == '"') {
+            // only \" and \\ are escapes inside double quotes
+            for (s++; *s != '"'; s++) {
+                if (*s == '\\' && (s[1] == '"' || s[1] == '\\')) {
+                    s++;
+                }
+                *d++ = *s;
+            }
+            s++;
+        }
+        else {
+            *d++ = *s++;
+        }
+    }
+    *d = '\0';
+    return d - dst;
+}
+
+
+token *lexList(const char *line) {
+    LexBuf lb = {NULL, 0, 0};
+    if (lex(line, strlen(line), &lb) <= 0) {
+        free(lb.tok);
+        return NULL;
+    }
+
+    // nodes, then strings, in one block
+    size_t bytes = lb.n * sizeof(token);
+    for (int i = 0; i < lb.n; i++) {
+        bytes += (lb.tok[i].type == SIMPLE) ? lb.tok[i].length + 1 : 4;
+    }
+    token *list = malloc(bytes);
+    char *text = (char *) (list + lb.n);
+    for (int i = 0; i < lb.n; i++) {
+        list[i].text = text;
+        list[i].type = lb.tok[i].type;
+        list[i].next = (i + 1 < lb.n) ? &list[i+1] : NULL;
+        text += lexText(line, &lb.tok[i], text) + 1;
+    }
+
+    free(lb.tok);
+    return list;
+}
+
+
+void freeLexList(token *list) {
+    free(list);
+}
@@ -0,0 +1,41 @@
+// lex.h
+//
+// Fast tokenizer for very long lines.  lex() splits a line into exactly the
+// tokens tokenize() would, but records each as an (offset, length, type)
+// entry in a contiguous array instead of a malloc()-ed list node and string.
+// Token boundaries are found 16 (SSE2) or 32 (AVX2) bytes at a time, with a
+// scalar fallback on other machines.
+//
+// lexList() materializes the array as a token list for parse(), with all
+// nodes and strings in a single block that freeLexList() releases.
+
+#include "process.h"
+
+typedef struct lexeme {
+    unsigned int offset;        // Start of token in line
+    unsigned int length;        // Length of token in line (including any
+                                //   quotes and backslashes)
+    unsigned char type;         // SIMPLE, RED_IN, ..., PAR_RIGHT
+    unsigned char quoted;       // Nonzero if a SIMPLE token contains quotes
+} Lexeme;                       //   or backslashes that must be removed
+
+typedef struct lexbuf {
+    Lexeme *tok;                // Tokens
+    int n;                      // Number of tokens
+    int size;                   // Number of tokens allocated
+} LexBuf;
+
+// Split the LEN bytes of LINE into tokens, appending them to OUT (which
+// must be zeroed before its first use).  Return the number of tokens, or -1
+// (after writing a message to stderr) on an unterminated string.
+int lex (const char *line, size_t len, LexBuf *out);
+
+// Write the text of token T in LINE, with quotes and backslashes removed,
+// to DST (which needs room for T->length + 1 bytes); return its length
+size_t lexText (const char *line, const Lexeme *t, char *dst);
+
+// Return the tokens of LINE as a list for parse() (NULL if none or error)
+token *lexList (const char *line);
+
+// Free a list returned by lexList()
+void freeLexList (token *list);
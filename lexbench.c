@@ -0,0 +1,89 @@
+// lexbench [MAXARGS]
+//
+// Tokenizer throughput in MB/s: lex() into a reused array, lexList() (lex()
+// plus the token list for parse()), and the original tokenize() (see lex.h).
+// Each line is "printf %s\n" with 10 to MAXARGS (default 100000) pathname
+// arguments and a redirection; each tokenizer runs on it for half a second.
+// tokenize() takes time quadratic in the length of the line, so it is timed
+// only on lines of up to 10000 arguments.  The default CFLAGS do not
+// optimize; add -O2 to compare the tokenizers as they would ship.
+#include "process.h"
+#include "lex.h"
+#include <time.h>
+
+// longest line given to tokenize()
+#define TOKENIZE_MAX 10000
+
+
+// FUNCTION DECLARATIONS
+// return the monotonic clock in seconds
+static double now(void);
+// return a malloc()-ed line with NARGS arguments, its length in *LEN
+static char *make_line(int nArgs, size_t *len);
+
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+static char *make_line(int nArgs, size_t *len) {
+    char *s = malloc(64 + nArgs * 48);
+    size_t n = sprintf(s, "printf %%s\\n");
+    for (int i = 0; i < nArgs; i++) {
+        n += sprintf(s + n, " /var/log/app/%05d/service-%d.log", i % 997, i);
+    }
+    n += sprintf(s + n, " > out.txt\n");
+    *len = n;
+    return s;
+}
+
+
+int main(int argc, char *argv[]) {
+    int maxArgs = (argc > 1) ? atoi(argv[1]) : 100000;
+
+    for (int nArgs = 10; nArgs <= maxArgs; nArgs *= 10) {
+        size_t len;
+        char *line = make_line(nArgs, &len);
+        double mb = len / 1e6;
+
+        LexBuf buf = {0};
+        int reps = 0;
+        double start = now(), t;
+        do {
+            buf.n = 0;
+            lex(line, len, &buf);
+            reps++;
+        } while ((t = now() - start) < 0.5);
+        double lexRate = mb * reps / t;
+
+        reps = 0;
+        start = now();
+        do {
+            freeLexList(lexList(line));
+            reps++;
+        } while ((t = now() - start) < 0.5);
+        double listRate = mb * reps / t;
+
+        printf("%7d args %9zu bytes  lex %8.1f MB/s  lexList %8.1f MB/s",
+               nArgs, len, lexRate, listRate);
+        if (nArgs <= TOKENIZE_MAX) {
+            reps = 0;
+            start = now();
+            do {
+                char *copy = strdup(line);
+                freeList(tokenize(copy));
+                free(copy);
+                reps++;
+            } while ((t = now() - start) < 0.5);
+            printf("  tokenize %8.2f MB/s", mb * reps / t);
+        }
+        printf("\n");
+
+        free(line);
+        free(buf.tok);
+    }
+    return 0;
+}
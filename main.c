@@ -5,58 +5,140 @@
 //
 // Bash version based on expression tree
 // Dumps token list or CMD tree if DUMP_LIST or DUMP_TREE is set.
+// Shields constructs the tokenizer cannot handle (see expand.h) and lexes
+// with the vectorized equivalent of tokenize() (see lex.h).
+// Executes the tree as compiled instructions (see compile.h), or walks it
+// recursively with process() if TREE_WALK is set.  Dumps the instructions
+// if DUMP_CODE is set.  Starts a zygote helper for launching commands if
+// ZYGOTE is set (see zygote.h).  Runs each job in its own process group when
+// stdin is a terminal (see jobs.h).  Counts its work for shellstat (see
+// shellstat.h).  Dumps each command as JSON if DUMP_JSON is set.
+//
+// Usage:  Bash                               Interactive shell on stdin
+//         Bash SCRIPT                        Run SCRIPT, keeping its parsed
+//                                              form in a cache (see script.h)
+//         Bash --server PATH [-j N]          Serve requests on a Unix socket
+//         Bash --client PATH [-C DIR] [-e NAME=VALUE]... COMMAND
+//                                            Send COMMAND to a server
+//         Bash --batch FILE [-j N] [-k] [-o RESULTS]
+//                                            Run lines of FILE in parallel
 
 #include "process.h"
+#include "compile.h"
+#include "expand.h"
+#include "zygote.h"
+#include "server.h"
+#include "batch.h"
+#include "lex.h"
+#include "jobs.h"
+#include "shellstat.h"
+#include "script.h"
+
+int main (int argc, char *argv[])
+{
+    stat_init();                                // Counters shared with
+						//   every child
+    setenv ("?", "0", 1);                       // Initial status
 
-int main()
+    setvbuf (stdin, NULL, _IONBF, 1);           // Disable buffering of stdin
+
+    if (argc > 2 && !strcmp (argv[1], "--server")) {
+	int nJobs = 0;                          // Concurrency limit (0 =
+	if (argc > 4 && !strcmp (argv[3], "-j"))  //   #CPUs)
+	    nJobs = atoi (argv[4]);
+	return serve (argv[2], nJobs);
+    }
+    if (argc > 2 && !strcmp (argv[1], "--client"))
+	return client (argc-2, argv+2);
+    if (argc > 2 && !strcmp (argv[1], "--batch"))
+	return batch (argc-2, argv+2);
+
+    if (getenv ("ZYGOTE"))                      // Fork launch helper while
+	zygote_start();                         //   the heap is still small
+
+    job_init();                                 // Signals and job control
+
+    if (argc > 1 && argv[1][0] != '-')          // Run script, parsed once
+	return run_script (argv[1]);            //   and cached
+
+    run_lines (true);
+    return EXIT_SUCCESS;
+}
+
+
+// Read, parse, and execute command lines from stdin until end of file,
+// prompting for each if PROMPT is true; return status of last command
+int run_lines (bool prompt)
 {
     int nCmd = 1;                   // Command number
     char *line = NULL;              // Space for line read
     token *list;                    // Linked list of tokens
     CMD *cmd;                       // Parsed command
 
-    setenv ("?", "0", 1);                       // Initial status
-
-    setvbuf (stdin, NULL, _IONBF, 1);           // Disable buffering of stdin
-
     size_t nLine = 0;                           // #chars allocated
     for ( ; ; ) {
-	printf ("(%d)$ ", nCmd);                // Prompt for command
-	fflush (stdout);
+	if (prompt) {
+	    printf ("(%d)$ ", nCmd);            // Prompt for command
+	    fflush (stdout);
+	}
 
 	if (getline (&line,&nLine, stdin) <= 0) // Read line
 	    break;                              //   Break on end of file
-
-	list = tokenize (line);                 // Lex line into tokens
-	if (list == NULL)
+	stat_add (ST_LINES, 1);
+
+	long start = stat_now();                // Time lexing and parsing
+	char *shielded = shield (line);         // Protect <(...) et al.
+	list = lexList (shielded);              // Lex line into tokens
+	free (shielded);
+	if (list == NULL) {
+	    stat_add (ST_PARSE_NS, stat_now() - start);
 	    continue;
+	}
 	else if (getenv ("DUMP_LIST"))          // Dump token list only if
 	    dumpList (list);                    //   environment variable set
 
 	cmd = parse (list);                     // Parsed command
-	freeList (list);                        // Free token list
+	freeLexList (list);                     // Free token list
+	stat_add (ST_PARSE_NS, stat_now() - start);
 	if (cmd == NULL)
 	    continue;
-	else if (getenv ("DUMP_TREE")) {        // Dump command tree if
-	    dumpTree (cmd, 0);                  //   environment variable set
-	    printf ("\n");
-	    fflush (stdout);
-	}
-
-	process (cmd);                          // Execute command
-
-	if (getenv ("DUMP_TREE_AGAIN")) {       // Dump command tree again if
-	    dumpTree (cmd, 0);                  //   environment variable set
-	    printf ("\n");
-	    fflush (stdout);
-	}
 
+	run_line (cmd);                         // Execute command
 	freeCMD (cmd);                          // Free CMD tree
 	nCmd++;                                 // Adjust prompt
     }
 
     free (line);
-    return EXIT_SUCCESS;
+    return atoi (getenv ("?"));
+}
+
+
+// Execute the parsed command line CMD, dumping it first as requested
+void run_line (CMD *cmd)
+{
+    if (getenv ("DUMP_TREE")) {                 // Dump command tree if
+	dumpTree (cmd, 0);                      //   environment variable set
+	printf ("\n");
+	fflush (stdout);
+    }
+    if (getenv ("DUMP_JSON"))                   // Dump it as JSON if
+	dumpJSON (cmd);                         //   environment variable set
+
+    if (getenv ("TREE_WALK"))                   // Walk command tree if
+	process (cmd);                          //   environment variable set
+    else {
+	Program *prog = compile (cmd);          // Else compile and execute
+	if (getenv ("DUMP_CODE"))               // Dump instructions if
+	    dumpProgram (prog);                 //   environment variable set
+	execute (prog);
+	freeProgram (prog);
+    }
+
+    if (getenv ("DUMP_TREE_AGAIN")) {           // Dump command tree again if
+	dumpTree (cmd, 0);                      //   environment variable set
+	printf ("\n");
+	fflush (stdout);
+    }
 }
 
 
@@ -0,0 +1,625 @@
+#include "param.h"
+#include "pathexp.h"
+#include "arith.h"
+#include <ctype.h>
+
+// bytes special in patterns
+#define PATTERN_SPECIAL "*?[\\"
+
+extern char **environ;
+
+static unsigned long nAssigned = 0;
+
+// result of ${NAME/PAT/REP}, built before it is copied to the caller's space
+static ParamBuf spare = {NULL, 0, 0};
+
+
+// FUNCTION DECLARATIONS
+// return the length of the name (or ?) at s[0..n), or 0
+static size_t name_length(const char *s, size_t n);
+// return the value of the variable named s[0..n), or NULL if unset
+static const char *lookup(const char *s, size_t n);
+// return true if s[0..n) has no quotes, \, or $
+static bool plain(const char *s, size_t n);
+// return the index of the first unquoted stop in s[i..n), or n
+static size_t word_end(const char *s, size_t n, size_t i, char stop);
+// append n bytes of s to b
+static void put(ParamBuf *b, const char *s, size_t n);
+// append byte c to b, with a \ before it if escape and it is special in
+// patterns
+static void put_literal(ParamBuf *b, char c, bool escape);
+// escape the bytes of b from offset from that are special in patterns
+static void escape_tail(ParamBuf *b, size_t from);
+// append the expansion of word s[0..n) to b, as a pattern if pattern;
+// return 0 or -1
+static int expand_part(ParamBuf *b, const char *s, size_t n, bool pattern);
+// return the byte that every match of pattern p[0..pn) starts (ends) with,
+// or -1 if there is none
+static int first_literal(const char *p, size_t pn);
+static int last_literal(const char *p, size_t pn);
+// return the length of the strings that pattern p[0..pn) matches if it has
+// no *, ?, or [...], or -1
+static long fixed_length(const char *p, size_t pn);
+// return the length of the shortest (longest) prefix of v[0..vn) matching
+// p[0..pn), or -1 if none does
+static long match_prefix(const char *p, size_t pn, const char *v, size_t vn, bool longest);
+// return the offset of the shortest (longest) suffix of v[0..vn) matching
+// p[0..pn), or -1 if none does
+static long match_suffix(const char *p, size_t pn, const char *v, size_t vn, bool longest);
+// find the leftmost longest match of p[0..pn) in v[from..vn), storing its
+// offset and length in *at and *len; return false if there is none
+static bool match_within(const char *p, size_t pn, const char *v, size_t vn, size_t from, size_t *at, size_t *len);
+// append to b the value v[0..vn) with the matches of pattern p[0..pn)
+// replaced by r[0..rn) as mode ('/', '#', '%', or 0 for one) says
+static void replace(ParamBuf *b, const char *v, size_t vn, const char *p, size_t pn, const char *r, size_t rn, char mode);
+// store in *x the value of the arithmetic expression s[0..n) (0 if empty),
+// using b for a copy; return 0 or -1
+static int offset(ParamBuf *b, const char *s, size_t n, long long *x);
+
+
+static size_t name_length(const char *s, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    if (s[0] == '?') {
+        return 1;
+    }
+    if (!(s[0] == '_' || isalpha((unsigned char) s[0]))) {
+        return 0;
+    }
+    size_t i = 1;
+    while (i < n && (s[i] == '_' || isalnum((unsigned char) s[i]))) {
+        i++;
+    }
+    return i;
+}
+
+
+static const char *lookup(const char *s, size_t n) {
+    for (char **e = environ; *e != NULL; e++) {
+        if (strncmp(*e, s, n) == 0 && (*e)[n] == '=') {
+            return *e + n + 1;
+        }
+    }
+    return NULL;
+}
+
+
+static bool plain(const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (strchr("'\"\\$", s[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+size_t param_length(const char *text) {
+    if (text[0] != '$') {
+        return 0;
+    }
+    if (text[1] == '?') {
+        return 2;
+    }
+    if (text[1] != '{') {
+        if (!(text[1] == '_' || isalpha((unsigned char) text[1]))) {
+            return 0;
+        }
+        size_t n = 2;
+        while (text[n] == '_' || isalnum((unsigned char) text[n])) {
+            n++;
+        }
+        return n;
+    }
+
+    // ${...} ends at the } that matches, outside quotes
+    int depth = 0;
+    for (size_t i = 2; text[i]; i++) {
+        char c = text[i];
+        if (c == '\\' && text[i+1]) {
+            i++;
+        }
+        else if (c == '\'' || c == '"') {
+            for (i++; text[i] && text[i] != c; i++) {
+                if (c == '"' && text[i] == '\\' && text[i+1]) {
+                    i++;
+                }
+            }
+            if (!text[i]) {
+                return 0;
+            }
+        }
+        else if (c == '$' && text[i+1] == '{') {
+            depth++;
+            i++;
+        }
+        else if (c == '}' && depth-- == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+
+static size_t word_end(const char *s, size_t n, size_t i, char stop) {
+    int quote = 0;
+    for ( ; i < n; i++) {
+        char c = s[i];
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+        }
+        else if (c == '\\' && i + 1 < n) {
+            i++;
+        }
+        else if (c == '"') {
+            quote = quote ? 0 : '"';
+        }
+        else if (c == '\'' && quote == 0) {
+            quote = '\'';
+        }
+        else if (c == '$' && quote == 0 && s[i+1] == '{') {
+            size_t len = param_length(s + i);
+            if (len > 0) {
+                i += len - 1;
+            }
+        }
+        else if (c == stop && quote == 0) {
+            return i;
+        }
+    }
+    return n;
+}
+
+
+static void put(ParamBuf *b, const char *s, size_t n) {
+    if (b->n + n > b->size) {
+        b->size = 2 * (b->n + n) + 64;
+        REALLOC(b->s, b->size);
+    }
+    memcpy(b->s + b->n, s, n);
+    b->n += n;
+}
+
+
+static void put_literal(ParamBuf *b, char c, bool escape) {
+    if (escape && strchr(PATTERN_SPECIAL, c)) {
+        put(b, "\\", 1);
+    }
+    put(b, &c, 1);
+}
+
+
+static void escape_tail(ParamBuf *b, size_t from) {
+    size_t k = 0;
+    for (size_t i = from; i < b->n; i++) {
+        k += (strchr(PATTERN_SPECIAL, b->s[i]) != NULL);
+    }
+    if (k == 0) {
+        return;
+    }
+
+    // grow, then spread the bytes out from the end
+    size_t end = b->n;
+    if (b->n + k > b->size) {
+        b->size = 2 * (b->n + k) + 64;
+        REALLOC(b->s, b->size);
+    }
+    b->n += k;
+    for (size_t i = end, j = b->n; i > from; ) {
+        char c = b->s[--i];
+        b->s[--j] = c;
+        if (strchr(PATTERN_SPECIAL, c)) {
+            b->s[--j] = '\\';
+        }
+    }
+}
+
+
+static int expand_part(ParamBuf *b, const char *s, size_t n, bool pattern) {
+    int quote = 0;
+    for (size_t i = 0; i < n; i++) {
+        char c = s[i];
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+            else {
+                put_literal(b, c, pattern);
+            }
+            continue;
+        }
+        if (c == '\\' && i + 1 < n) {
+            // in "..." only \$, \", and \\ lose the backslash
+            if (quote == '"' && !strchr("$\"\\", s[i+1])) {
+                put_literal(b, c, pattern);
+            }
+            else {
+                put_literal(b, s[++i], pattern);
+            }
+            continue;
+        }
+        if (c == '"') {
+            quote = quote ? 0 : '"';
+            continue;
+        }
+        if (c == '\'' && quote == 0) {
+            quote = '\'';
+            continue;
+        }
+
+        size_t len;
+        if (c == '$' && (len = param_length(s + i)) > 0 && len <= n - i) {
+            size_t before = b->n;
+            const char *v;
+            size_t vn;
+            if (param_expand(s + i, len, b, &v, &vn) < 0) {
+                return -1;
+            }
+            if (b->n == before) {
+                put(b, v, vn);
+            }
+            if (pattern && quote) {
+                escape_tail(b, before);
+            }
+            i += len - 1;
+            continue;
+        }
+        put_literal(b, c, pattern && quote);
+    }
+    return 0;
+}
+
+
+static int first_literal(const char *p, size_t pn) {
+    if (pn == 0 || strchr("*?[", p[0])) {
+        return -1;
+    }
+    if (p[0] == '\\') {
+        return (pn > 1) ? (unsigned char) p[1] : -1;
+    }
+    return (unsigned char) p[0];
+}
+
+
+static int last_literal(const char *p, size_t pn) {
+    if (pn == 0 || strchr("*?]", p[pn-1])) {
+        return -1;
+    }
+    // a byte after an odd number of \ is escaped; a \ after an even number
+    // escapes nothing
+    size_t k = 0;
+    while (k + 1 < pn && p[pn-2-k] == '\\') {
+        k++;
+    }
+    if (p[pn-1] == '\\' && k % 2 == 0) {
+        return -1;
+    }
+    return (unsigned char) p[pn-1];
+}
+
+
+static long fixed_length(const char *p, size_t pn) {
+    if (pattern_magic(p, pn)) {
+        return -1;
+    }
+    long n = 0;
+    for (size_t i = 0; i < pn; i++, n++) {
+        if (p[i] == '\\' && i + 1 < pn) {
+            i++;
+        }
+    }
+    return n;
+}
+
+
+static long match_prefix(const char *p, size_t pn, const char *v, size_t vn, bool longest) {
+    long fixed = fixed_length(p, pn);
+    if (fixed >= 0) {
+        return ((size_t) fixed <= vn && pattern_match(p, pn, v, fixed)) ? fixed : -1;
+    }
+    int last = last_literal(p, pn);
+    for (size_t k = 0; k <= vn; k++) {
+        size_t i = longest ? vn - k : k;
+        if (last >= 0 && (i == 0 || (unsigned char) v[i-1] != last)) {
+            continue;
+        }
+        if (pattern_match(p, pn, v, i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static long match_suffix(const char *p, size_t pn, const char *v, size_t vn, bool longest) {
+    long fixed = fixed_length(p, pn);
+    if (fixed >= 0) {
+        return ((size_t) fixed <= vn && pattern_match(p, pn, v + vn - fixed, fixed)) ? (long) (vn - fixed) : -1;
+    }
+    int first = first_literal(p, pn);
+    for (size_t k = 0; k <= vn; k++) {
+        size_t i = longest ? k : vn - k;
+        if (first >= 0 && (i == vn || (unsigned char) v[i] != first)) {
+            continue;
+        }
+        if (pattern_match(p, pn, v + i, vn - i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static bool match_within(const char *p, size_t pn, const char *v, size_t vn, size_t from, size_t *at, size_t *len) {
+    long fixed = fixed_length(p, pn);
+    int first = first_literal(p, pn);
+    int last = last_literal(p, pn);
+    for (size_t i = from; i <= vn; i++) {
+        if (first >= 0 && (i == vn || (unsigned char) v[i] != first)) {
+            continue;
+        }
+        if (fixed >= 0) {
+            if ((size_t) fixed <= vn - i && pattern_match(p, pn, v + i, fixed)) {
+                *at = i;
+                *len = fixed;
+                return true;
+            }
+            continue;
+        }
+        for (size_t j = vn; j + 1 > i; j--) {
+            if (last >= 0 && (j == i || (unsigned char) v[j-1] != last)) {
+                continue;
+            }
+            if (pattern_match(p, pn, v + i, j - i)) {
+                *at = i;
+                *len = j - i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+static void replace(ParamBuf *b, const char *v, size_t vn, const char *p, size_t pn, const char *r, size_t rn, char mode) {
+    long i;
+    if (mode == '#') {
+        if ((i = match_prefix(p, pn, v, vn, true)) >= 0) {
+            put(b, r, rn);
+            v += i;
+            vn -= i;
+        }
+        put(b, v, vn);
+        return;
+    }
+    if (mode == '%') {
+        if ((i = match_suffix(p, pn, v, vn, true)) >= 0) {
+            put(b, v, i);
+            put(b, r, rn);
+            return;
+        }
+        put(b, v, vn);
+        return;
+    }
+
+    size_t from = 0, at, len;
+    while (from <= vn && match_within(p, pn, v, vn, from, &at, &len)) {
+        put(b, v + from, at - from);
+        put(b, r, rn);
+        from = at + len;
+        // an empty match replaces nothing between one byte and the next,
+        // but none is tried at the end once a match has reached it
+        if (len > 0 && from == vn) {
+            break;
+        }
+        if (len == 0) {
+            if (at < vn) {
+                put(b, v + at, 1);
+            }
+            from++;
+        }
+        if (mode != '/') {
+            break;
+        }
+    }
+    if (from < vn) {
+        put(b, v + from, vn - from);
+    }
+}
+
+
+static int offset(ParamBuf *b, const char *s, size_t n, long long *x) {
+    size_t start = b->n;
+    if (expand_part(b, s, n, false) < 0) {
+        return -1;
+    }
+    put(b, "", 1);
+    int r = 0;
+    *x = 0;
+    if (b->s[start] != '\0') {
+        r = arith_eval(b->s + start, x);
+    }
+    b->n = start;
+    return r;
+}
+
+
+int param_expand(const char *text, size_t n, ParamBuf *scratch, const char **value, size_t *length) {
+    size_t start = scratch->n;
+    *value = "";
+    *length = 0;
+
+    // $NAME and $?
+    if (text[1] != '{') {
+        const char *v = lookup(text + 1, n - 1);
+        if (v != NULL) {
+            *value = v;
+            *length = strlen(v);
+        }
+        return 0;
+    }
+
+    const char *body = text + 2;
+    size_t bn = n - 3;
+    bool count = (bn > 1 && body[0] == '#');
+    size_t k = count ? 1 : 0;
+    size_t nameLen = name_length(body + k, bn - k);
+    const char *op = body + k + nameLen;
+    size_t on = bn - k - nameLen;
+    if (nameLen == 0 || (count && on > 0)) {
+        fprintf(stderr, "%.*s: bad substitution\n", (int) n, text);
+        return -1;
+    }
+    const char *v = lookup(body + k, nameLen);
+    size_t vn = v ? strlen(v) : 0;
+
+    // ${NAME} and ${#NAME}
+    if (count) {
+        char digits[24];
+        int dn = sprintf(digits, "%zu", vn);
+        put(scratch, digits, dn);
+        *value = scratch->s + start;
+        *length = dn;
+        return 0;
+    }
+    if (on == 0) {
+        *value = v ? v : "";
+        *length = vn;
+        return 0;
+    }
+
+    // ${NAME:-WORD}, ${NAME=WORD}, etc.
+    bool colon = (op[0] == ':');
+    char kind = (on > (size_t) colon) ? op[colon] : '\0';
+    if (kind == '-' || kind == '=' || kind == '+') {
+        const char *word = op + colon + 1;
+        size_t wn = on - colon - 1;
+        bool set = (v != NULL && (!colon || vn > 0));
+        if (kind != '+' && set) {
+            *value = v;
+            *length = vn;
+            return 0;
+        }
+        if (kind == '+' && !set) {
+            return 0;
+        }
+        // a word with nothing to expand is used where it lies
+        if (kind != '=' && plain(word, wn)) {
+            *value = word;
+            *length = wn;
+            return 0;
+        }
+        if (expand_part(scratch, word, wn, false) < 0) {
+            scratch->n = start;
+            return -1;
+        }
+        if (kind == '=') {
+            char name[nameLen + 1];
+            memcpy(name, body, nameLen);
+            name[nameLen] = '\0';
+            put(scratch, "", 1);
+            setenv(name, scratch->s + start, 1);
+            scratch->n--;
+            nAssigned++;
+        }
+        *length = scratch->n - start;
+        *value = (*length > 0) ? scratch->s + start : "";
+        return 0;
+    }
+
+    // ${NAME#PAT}, ${NAME##PAT}, ${NAME%PAT}, and ${NAME%%PAT}
+    if (op[0] == '#' || op[0] == '%') {
+        bool longest = (on > 1 && op[1] == op[0]);
+        if (expand_part(scratch, op + 1 + longest, on - 1 - longest, true) < 0) {
+            scratch->n = start;
+            return -1;
+        }
+        const char *p = scratch->s + start;
+        size_t pn = scratch->n - start;
+        scratch->n = start;
+        *value = v ? v : "";
+        *length = vn;
+        long i;
+        if (op[0] == '#' && (i = match_prefix(p, pn, *value, vn, longest)) >= 0) {
+            *value += i;
+            *length -= i;
+        }
+        else if (op[0] == '%' && (i = match_suffix(p, pn, *value, vn, longest)) >= 0) {
+            *length = i;
+        }
+        return 0;
+    }
+
+    // ${NAME/PAT/REP}, ${NAME//PAT/REP}, ${NAME/#PAT/REP}, ${NAME/%PAT/REP}
+    if (op[0] == '/') {
+        char mode = (on > 1 && strchr("/#%", op[1])) ? op[1] : '\0';
+        size_t pat = 1 + (mode != '\0');
+        // ${NAME///...} replaces every /
+        size_t slash = word_end(op, on, pat + (mode == '/' && pat < on && op[pat] == '/'), '/');
+        if (expand_part(scratch, op + pat, slash - pat, true) < 0) {
+            scratch->n = start;
+            return -1;
+        }
+        size_t pn = scratch->n - start;
+        if (slash < on && expand_part(scratch, op + slash + 1, on - slash - 1, false) < 0) {
+            scratch->n = start;
+            return -1;
+        }
+        size_t rn = scratch->n - start - pn;
+        if (pn == 0 && (mode == '\0' || mode == '/')) {
+            scratch->n = start;
+            *value = v ? v : "";
+            *length = vn;
+            return 0;
+        }
+
+        // build the result aside, then put it where the pattern was
+        spare.n = 0;
+        replace(&spare, v ? v : "", vn, scratch->s + start, pn, scratch->s + start + pn, rn, mode);
+        scratch->n = start;
+        put(scratch, spare.s, spare.n);
+        *length = spare.n;
+        *value = (*length > 0) ? scratch->s + start : "";
+        return 0;
+    }
+
+    // ${NAME:OFF} and ${NAME:OFF:LEN}
+    if (colon) {
+        size_t sep = word_end(op, on, 1, ':');
+        long long off, len = vn;
+        if (offset(scratch, op + 1, sep - 1, &off) < 0
+                || (sep < on && offset(scratch, op + sep + 1, on - sep - 1, &len) < 0)) {
+            return -1;
+        }
+        if (off < 0) {
+            off += vn;
+        }
+        if (off < 0 || (size_t) off > vn) {
+            return 0;
+        }
+        if (len < 0) {
+            len += vn - off;
+            if (len < 0) {
+                fprintf(stderr, "%.*s: substring expression < 0\n", (int) n, text);
+                return -1;
+            }
+        }
+        if (len == 0) {
+            return 0;
+        }
+        *value = v + off;
+        *length = ((size_t) len < vn - off) ? (size_t) len : vn - off;
+        return 0;
+    }
+
+    fprintf(stderr, "%.*s: bad substitution\n", (int) n, text);
+    return -1;
+}
+
+
+unsigned long param_assigned(void) {
+    return nAssigned;
+}
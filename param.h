@@ -0,0 +1,60 @@
+// param.h
+//
+// Parameter expansion.  A reference is $NAME, $?, or ${...}, where NAME is
+// a letter or _ followed by letters, digits, and _, and names an environment
+// variable ($? is the status of the last command):
+//
+//   ${NAME}             The value of NAME ("" if unset)
+//   ${#NAME}            Its length in bytes
+//   ${NAME:-WORD}       WORD if NAME is unset or empty, else its value
+//   ${NAME:=WORD}       The same, also setting NAME to WORD
+//   ${NAME:+WORD}       WORD if NAME is set and not empty, else ""
+//                       (without the colon, these test only whether NAME is
+//                       set)
+//   ${NAME#PAT}         The value less the shortest prefix matching PAT
+//   ${NAME##PAT}        ... less the longest such prefix
+//   ${NAME%PAT}         ... less the shortest suffix matching PAT
+//   ${NAME%%PAT}        ... less the longest such suffix
+//   ${NAME/PAT/REP}     The value with the leftmost longest match of PAT
+//                       replaced by REP (or removed if /REP is omitted); //
+//                       replaces every match, /# only one at the start, and
+//                       /% only one at the end
+//   ${NAME:OFF:LEN}     LEN bytes (default: the rest) of the value starting
+//                       at OFF, both arithmetic expressions (see arith.h); a
+//                       negative OFF counts from the end (write ${X: -1}),
+//                       and a negative LEN leaves that many bytes off the end
+//
+// PATs are patterns as for pathnames (see pathexp.h), except that * and ?
+// also match / and a leading dot.  WORD, PAT, and REP may be quoted with
+// '...', "...", and \, and may contain references, whose values are literal
+// in a PAT only if quoted.
+//
+// Results that are part of a value are never copied: prefixes, suffixes,
+// and substrings are found by matching the value where it lies, and only
+// text that has to be built (a WORD, a replacement, or a length) is put in
+// scratch space that the caller keeps and reuses.  Patterns without *, ?,
+// or [...] are compared at the one length they can match, and the first or
+// last byte of others, if literal, rules out most positions without a call
+// to pattern_match().
+
+#include "process.h"
+
+// scratch space for results that have to be built
+typedef struct paramBuf {
+    char *s;            // contents (not NUL-terminated)
+    size_t n;           // length
+    size_t size;        // bytes allocated
+} ParamBuf;
+
+// Return the length of the reference at TEXT (0 if it does not start one)
+size_t param_length (const char *text);
+
+// Expand the reference TEXT[0..N) and store in *VALUE and *LENGTH where the
+// result is.  It is either part of the value of a variable or of TEXT, and
+// SCRATCH is left as it was, or has been appended to SCRATCH, which grows
+// by exactly *LENGTH (and *VALUE is valid until SCRATCH next grows).  Return
+// 0, or -1 after writing a message to stderr if the reference is malformed.
+int param_expand (const char *text, size_t n, ParamBuf *scratch, const char **value, size_t *length);
+
+// Return the number of variables set by ${NAME:=WORD} so far
+unsigned long param_assigned (void);
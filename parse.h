@@ -249,6 +249,23 @@ void dumpTree (CMD *exec, int level);
 void freeCMD (CMD *cmd);
 
 
+// Serialize the command structures CMD[0..N) (any of which may be NULL) as
+// one block (see script.h for its format); return the block malloc()-ed and
+// store its size in *SIZE
+void *packCMD (CMD **cmd, int n, size_t *size);
+
+
+// Return a malloc()-ed array of the command structures serialized in the
+// SIZE bytes at BLOCK and store their number in *N (NULL if BLOCK is not a
+// valid serialization).  Their strings point into BLOCK, which must outlive
+// them; a single free() of the array releases everything else.
+CMD **unpackCMD (const void *block, size_t size, int *n);
+
+
+// Print the command structure CMD as one line of JSON
+void dumpJSON (CMD *cmd);
+
+
 // Parse a token list into a command structure and return a pointer to
 // that structure (NULL if errors found).
 CMD *parse (token *tok);
@@ -0,0 +1,448 @@
+#include "pathexp.h"
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+
+// bytes of directory entries fetched per getdents64()
+#define DENTS_SIZE (256 * 1024)
+
+// most threads walking below **
+#define MAX_WALKERS 16
+
+
+// one /-separated component of the pattern
+typedef struct comp {
+    const char *p;      // pattern text (not NUL-terminated)
+    size_t n;           // its length
+    bool magic;         // contains *, ?, or [...]
+    bool globstar;      // is exactly **
+} Comp;
+
+// directory still to be walked below **
+typedef struct task {
+    char *dir;          // path of the directory
+    int k;              // index of the ** component
+} Task;
+
+// state shared by all threads expanding one pattern
+typedef struct walk {
+    Comp *comps;        // components
+    int nComp;
+    bool dirOnly;       // pattern ended in /
+    bool pool;          // threads are running (lock before touching below)
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char **out;         // matches found so far
+    int nOut, sizeOut;
+    Task *tasks;        // stack of directories below ** to walk
+    int nTask, sizeTask;
+    int busy;           // threads running a task
+} Walk;
+
+
+// FUNCTION DECLARATIONS
+// match one [...] at p[0..pn) against c; return its length (0 = no ])
+static size_t bracket(const char *p, size_t pn, unsigned char c, bool *hit);
+// return malloc()-ed DIR/NAME[0..n), with a / appended if slash
+static char *join(const char *dir, const char *name, size_t n, bool slash);
+// return true if entry NAME of directory FD is a directory
+static bool is_dir(int fd, const char *name, unsigned char type, bool follow);
+// add path to the matches
+static void add_match(Walk *w, char *path);
+// queue directory DIR to be walked for the ** at component k
+static void add_task(Walk *w, char *dir, int k);
+// match components k.. of the pattern below DIR; bufs[] holds the
+// per-component getdents64() buffers of the calling thread
+static void expand_at(Walk *w, char **bufs, const char *dir, int k);
+// run queued tasks until none are left and no thread is busy
+static void *walker(void *arg);
+// qsort() comparison of two strings
+static int compare_paths(const void *a, const void *b);
+
+
+static size_t bracket(const char *p, size_t pn, unsigned char c, bool *hit) {
+    size_t i = 1;
+    bool negate = false;
+    if (i < pn && (p[i] == '!' || p[i] == '^')) {
+        negate = true;
+        i++;
+    }
+
+    // a ] first in the set is literal
+    bool found = false;
+    for (bool first = true; i < pn && (p[i] != ']' || first); first = false) {
+        unsigned char lo = p[i];
+        if (lo == '\\' && i + 1 < pn) {
+            lo = p[++i];
+        }
+        i++;
+        unsigned char hi = lo;
+        if (i + 1 < pn && p[i] == '-' && p[i+1] != ']') {
+            i++;
+            if (p[i] == '\\' && i + 1 < pn) {
+                i++;
+            }
+            hi = p[i++];
+        }
+        if (lo <= c && c <= hi) {
+            found = true;
+        }
+    }
+    if (i >= pn) {
+        return 0;
+    }
+    *hit = (found != negate);
+    return i + 1;
+}
+
+
+bool pattern_magic(const char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        bool hit;
+        if (p[i] == '\\') {
+            i++;
+        }
+        else if (p[i] == '*' || p[i] == '?') {
+            return true;
+        }
+        else if (p[i] == '[' && bracket(p + i, n - i, 0, &hit) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool pattern_match(const char *p, size_t pn, const char *s, size_t sn) {
+    // on a mismatch, let the last * absorb one more character and retry
+    size_t pi = 0, si = 0;
+    size_t star_p = 0, star_s = 0;
+    bool star = false;
+
+    while (si < sn) {
+        bool ok = false;
+        if (pi < pn) {
+            char c = p[pi];
+            size_t len = 1;
+            bool hit = false;
+            if (c == '*') {
+                star = true;
+                star_p = ++pi;
+                star_s = si;
+                continue;
+            }
+            else if (c == '?') {
+                ok = true;
+            }
+            else if (c == '[' && (len = bracket(p + pi, pn - pi, s[si], &hit)) > 0) {
+                ok = hit;
+            }
+            else {
+                len = 1;
+                if (c == '\\' && pi + 1 < pn) {
+                    c = p[pi+1];
+                    len = 2;
+                }
+                ok = (c == s[si]);
+            }
+            if (ok) {
+                pi += len;
+                si++;
+            }
+        }
+        if (!ok) {
+            if (!star) {
+                return false;
+            }
+            pi = star_p;
+            si = ++star_s;
+        }
+    }
+
+    while (pi < pn && p[pi] == '*') {
+        pi++;
+    }
+    return pi == pn;
+}
+
+
+static char *join(const char *dir, const char *name, size_t n, bool slash) {
+    size_t dn = strlen(dir);
+    char *path = malloc(dn + n + 3);
+    memcpy(path, dir, dn);
+    if (dn > 0 && dir[dn-1] != '/') {
+        path[dn++] = '/';
+    }
+    memcpy(path + dn, name, n);
+    dn += n;
+    if (slash) {
+        path[dn++] = '/';
+    }
+    path[dn] = '\0';
+    return path;
+}
+
+
+static bool is_dir(int fd, const char *name, unsigned char type, bool follow) {
+    if (type == DT_DIR) {
+        return true;
+    }
+    if (type != DT_UNKNOWN && (type != DT_LNK || !follow)) {
+        return false;
+    }
+    struct stat st;
+    return fstatat(fd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0
+        && S_ISDIR(st.st_mode);
+}
+
+
+static void add_match(Walk *w, char *path) {
+    if (w->pool) {
+        pthread_mutex_lock(&w->lock);
+    }
+    if (w->nOut == w->sizeOut) {
+        w->sizeOut = w->sizeOut ? 2 * w->sizeOut : 16;
+        REALLOC(w->out, w->sizeOut);
+    }
+    w->out[w->nOut++] = path;
+    if (w->pool) {
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+
+static void add_task(Walk *w, char *dir, int k) {
+    pthread_mutex_lock(&w->lock);
+    if (w->nTask == w->sizeTask) {
+        w->sizeTask = w->sizeTask ? 2 * w->sizeTask : 64;
+        REALLOC(w->tasks, w->sizeTask);
+    }
+    w->tasks[w->nTask].dir = dir;
+    w->tasks[w->nTask].k = k;
+    w->nTask++;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+
+static void expand_at(Walk *w, char **bufs, const char *dir, int k) {
+    const Comp *c = &w->comps[k];
+    bool last = (k == w->nComp - 1);
+
+    // literal component: no need to read the directory
+    if (!c->magic && !c->globstar) {
+        char *name = malloc(c->n + 1);
+        size_t n = 0;
+        for (size_t i = 0; i < c->n; i++) {
+            if (c->p[i] == '\\' && i + 1 < c->n) {
+                i++;
+            }
+            name[n++] = c->p[i];
+        }
+        char *path = join(dir, name, n, false);
+        free(name);
+
+        if (!last) {
+            expand_at(w, bufs, path, k + 1);
+            free(path);
+            return;
+        }
+        struct stat st;
+        if (w->dirOnly ? (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+                       : lstat(path, &st) == 0) {
+            if (w->dirOnly) {
+                char *slashed = join(path, "", 0, true);
+                free(path);
+                path = slashed;
+            }
+            add_match(w, path);
+        }
+        else {
+            free(path);
+        }
+        return;
+    }
+
+    // ** matches no directories at all ...
+    if (c->globstar) {
+        expand_at(w, bufs, dir, k + 1);
+    }
+
+    int fd = open(*dir ? dir : ".", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (bufs[k] == NULL) {
+        bufs[k] = malloc(DENTS_SIZE);
+    }
+
+    // a leading . must be matched explicitly
+    bool dots = (c->n > 0 && c->p[0] == '.')
+             || (c->n > 1 && c->p[0] == '\\' && c->p[1] == '.');
+
+    long got;
+    while ((got = syscall(SYS_getdents64, fd, bufs[k], DENTS_SIZE)) > 0) {
+        for (long off = 0; off < got; ) {
+            struct dirent64 *d = (struct dirent64 *) (bufs[k] + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (!dots || name[1] == '\0'
+                                   || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            size_t n = strlen(name);
+
+            // ... or any number, each walked as a separate task
+            if (c->globstar) {
+                if (is_dir(fd, name, d->d_type, false)) {
+                    add_task(w, join(dir, name, n, false), k);
+                }
+                continue;
+            }
+
+            if (!pattern_match(c->p, c->n, name, n)) {
+                continue;
+            }
+            if ((!last || w->dirOnly) && !is_dir(fd, name, d->d_type, true)) {
+                continue;
+            }
+            char *path = join(dir, name, n, last && w->dirOnly);
+            if (last) {
+                add_match(w, path);
+            }
+            else {
+                expand_at(w, bufs, path, k + 1);
+                free(path);
+            }
+        }
+    }
+    close(fd);
+}
+
+
+static void *walker(void *arg) {
+    Walk *w = arg;
+    char **bufs = calloc(w->nComp, sizeof(char *));
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->nTask == 0 && w->busy > 0) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->nTask == 0) {
+            break;
+        }
+        Task t = w->tasks[--w->nTask];
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+
+        expand_at(w, bufs, t.dir, t.k);
+        free(t.dir);
+
+        pthread_mutex_lock(&w->lock);
+        w->busy--;
+        if (w->nTask == 0 && w->busy == 0) {
+            pthread_cond_broadcast(&w->cond);
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    for (int i = 0; i < w->nComp; i++) {
+        free(bufs[i]);
+    }
+    free(bufs);
+    return NULL;
+}
+
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+int pathexp(const char *pattern, char ***matches) {
+    *matches = NULL;
+
+    Walk w;
+    memset(&w, 0, sizeof(w));
+    const char *base = (pattern[0] == '/') ? "/" : "";
+
+    // split into components, skipping empty ones; a final ** means **/*
+    size_t len = strlen(pattern);
+    w.comps = malloc((len + 2) * sizeof(Comp));
+    bool globstar = false;
+    for (size_t i = 0; i < len; ) {
+        size_t j = i;
+        while (j < len && pattern[j] != '/') {
+            j += (pattern[j] == '\\' && j + 1 < len) ? 2 : 1;
+        }
+        if (j > i) {
+            Comp *c = &w.comps[w.nComp++];
+            c->p = pattern + i;
+            c->n = j - i;
+            c->globstar = (c->n == 2 && c->p[0] == '*' && c->p[1] == '*');
+            c->magic = !c->globstar && pattern_magic(c->p, c->n);
+            globstar |= c->globstar;
+        }
+        i = j + 1;
+    }
+    w.dirOnly = (len > 0 && pattern[len-1] == '/');
+    if (w.nComp > 0 && w.comps[w.nComp-1].globstar) {
+        Comp *c = &w.comps[w.nComp++];
+        c->p = "*";
+        c->n = 1;
+        c->magic = true;
+        c->globstar = false;
+    }
+    if (w.nComp == 0) {
+        free(w.comps);
+        return 0;
+    }
+
+    if (!globstar) {
+        // one thread is enough without **
+        char **bufs = calloc(w.nComp, sizeof(char *));
+        expand_at(&w, bufs, base, 0);
+        for (int i = 0; i < w.nComp; i++) {
+            free(bufs[i]);
+        }
+        free(bufs);
+    }
+    else {
+        long nCPU = sysconf(_SC_NPROCESSORS_ONLN);
+        int nThread = (nCPU < 1) ? 1 : (nCPU > MAX_WALKERS) ? MAX_WALKERS : nCPU;
+
+        pthread_mutex_init(&w.lock, NULL);
+        pthread_cond_init(&w.cond, NULL);
+        w.pool = true;
+        add_task(&w, strdup(base), 0);
+
+        // the calling thread walks too
+        pthread_t *threads = malloc(nThread * sizeof(pthread_t));
+        int started = 0;
+        for (int i = 1; i < nThread; i++) {
+            if (pthread_create(&threads[started], NULL, walker, &w) == 0) {
+                started++;
+            }
+        }
+        walker(&w);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        free(w.tasks);
+        pthread_cond_destroy(&w.cond);
+        pthread_mutex_destroy(&w.lock);
+    }
+    free(w.comps);
+
+    if (w.nOut > 1) {
+        qsort(w.out, w.nOut, sizeof(char *), compare_paths);
+    }
+    *matches = w.out;
+    return w.nOut;
+}
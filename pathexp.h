@@ -0,0 +1,29 @@
+// pathexp.h
+//
+// Pathname expansion.  A pattern is a /-separated path whose components may
+// contain
+//
+//   *        Any string (but not a leading . of a file name)
+//   ?        Any single character (but not a leading .)
+//   [...]    Any one character in the set; [!...] or [^...] negates, a-z is
+//            a range, and a ] first in the set is literal
+//   \c       The character c itself
+//
+// A component that is exactly ** matches zero or more directories; hidden
+// directories and symbolic links to directories are not descended into.
+// Subtrees below ** are walked in parallel by a pool of threads.
+//
+// Directories are read with getdents64() into large buffers, and names are
+// matched in place, so nothing is allocated for entries that do not match.
+
+#include "process.h"
+
+// Return true if the pattern P[0..N) contains *, ?, or a complete [...]
+bool pattern_magic (const char *p, size_t n);
+
+// Return true if S[0..SN) matches the pattern P[0..PN)
+bool pattern_match (const char *p, size_t pn, const char *s, size_t sn);
+
+// Set *MATCHES to a sorted, malloc()-ed array of the malloc()-ed pathnames
+// that match PATTERN and return their number (0 = none; *MATCHES = NULL)
+int pathexp (const char *pattern, char ***matches);
@@ -0,0 +1,111 @@
+#include "pipeprof.h"
+#include "shellstat.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+
+// FUNCTION DECLARATIONS
+// move everything from in to out, then report; never returns
+static void relay(int in, int out, int edge);
+// wait until fd is ready for events; return milliseconds waited
+static double wait_ms(int fd, short events);
+
+
+bool pipeprof_enabled(void) {
+    return getenv("PIPEPROF") != NULL;
+}
+
+
+int pipeprof_start(int pipefd[2], int edge) {
+    int out[2];
+    if (pipe(out) < 0) {
+        perror("Pipe failure");
+        return -1;
+    }
+    stat_add(ST_PIPES, 1);
+
+    stat_add(ST_FORKS, 1);
+    int pid = fork();
+    if (pid < 0) {
+        perror("Fork failure");
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(pipefd[1]);
+        close(out[0]);
+        relay(pipefd[0], out[1], edge);
+    }
+
+    // consumer now reads from the relay
+    close(pipefd[0]);
+    close(out[1]);
+    pipefd[0] = out[0];
+    return pid;
+}
+
+
+static void relay(int in, int out, int edge) {
+    // a consumer that exits early shows up as EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, SIG_IGN);
+
+    long long bytes = 0;
+    long chunks = 0;
+    double blocked = 0;
+    double starved = 0;
+
+    for ( ; ; ) {
+        // parse.o exports its own splice(), so call the system call directly
+        ssize_t n = syscall(SYS_splice, in, NULL, out, NULL, 1 << 20,
+                            SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            bytes += n;
+            chunks++;
+            continue;
+        }
+        if (n == 0 || errno != EAGAIN) {
+            break;
+        }
+
+        // find out which side we are waiting on
+        struct pollfd pin = {in, POLLIN, 0};
+        if (poll(&pin, 1, 0) == 0) {
+            starved += wait_ms(in, POLLIN);
+        }
+        else {
+            blocked += wait_ms(out, POLLOUT);
+        }
+    }
+    close(in);
+    close(out);
+
+    fprintf(stderr, "pipeprof: edge %d -> %d: %lld bytes, %ld chunks, "
+            "producer blocked %.1f ms, consumer starved %.1f ms\n",
+            edge - 1, edge, bytes, chunks, blocked, starved);
+    _exit(0);
+}
+
+
+static double wait_ms(int fd, short events) {
+    struct timespec a;
+    struct timespec b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    struct pollfd p = {fd, events, 0};
+    while (poll(&p, 1, -1) < 0 && errno == EINTR)
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    return (b.tv_sec - a.tv_sec) * 1e3 + (b.tv_nsec - a.tv_nsec) / 1e6;
+}
+
+
+void pipeprof_stage(const CMD *cmdList, int stage, const struct rusage *usage) {
+    const char *name = (cmdList->type == SIMPLE) ? cmdList->argv[0] : "(subcommand)";
+    fprintf(stderr, "pipeprof: stage %d (%s): user %.3f s, sys %.3f s\n", stage, name,
+            usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6,
+            usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6);
+}
@@ -0,0 +1,29 @@
+// pipeprof.h
+//
+// Pipeline profiler.  If PIPEPROF is set, pipe_command() puts a relay
+// process on every edge of a pipeline.  The relay moves data from the
+// producer's pipe to the consumer's pipe with splice(2), so nothing is
+// copied, and on EOF reports on stderr
+//
+//   pipeprof: edge K-1 -> K: BYTES bytes, CHUNKS chunks,
+//             producer blocked MS ms, consumer starved MS ms
+//
+// where "blocked" is time the consumer's pipe was full (stage K is the
+// bottleneck) and "starved" is time the producer's pipe was empty (stage
+// K-1 is).  After the pipeline exits, each stage's CPU time is reported
+//
+//   pipeprof: stage K (NAME): user S s, sys S s
+
+#include "process.h"
+#include <sys/resource.h>
+
+// Return true if pipelines should be profiled
+bool pipeprof_enabled (void);
+
+// Insert a relay for edge EDGE-1 -> EDGE into the pipe PIPEFD: on return
+// PIPEFD[0] is the read end of a new pipe fed by the relay.  Return the
+// relay's pid, or -1 (with PIPEFD unchanged) on error
+int pipeprof_start (int pipefd[2], int edge);
+
+// Report resource usage USAGE of stage CMDLIST, stage number STAGE
+void pipeprof_stage (const CMD *cmdList, int stage, const struct rusage *usage);
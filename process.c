@@ -1,4 +1,18 @@
 #include "process.h"
+#include "affinity.h"
+#include "tee.h"
+#include "expand.h"
+#include "zygote.h"
+#include "pipeprof.h"
+#include "argsplit.h"
+#include "read.h"
+#include "jobs.h"
+#include "subshell.h"
+#include "threadpipe.h"
+#include "shellstat.h"
+#include "cached.h"
+#include "timeout.h"
+#include "coproc.h"
 
 
 // FUNCTION DECLARATIONS
@@ -10,6 +24,8 @@ void redirect_stdin(const CMD *cmdList);
 void redirect_stdout(const CMD *cmdList);
 // handles PIPE commands
 int pipe_command(const CMD *cmdList);
+// runs one stage of a pipeline in its forked child
+int pipe_stage(const CMD *cmdList);
 // handles SEP_AND commands
 int and_command(const CMD *cmdList);
 // handles SEP_OR commands
@@ -20,21 +36,28 @@ int sub_command(const CMD *cmdList);
 int end_command(const CMD *cmdList);
 // handles SEP_BG commands
 int background_command(const CMD *cmdList);
-// helper for SEP_BG function
-int background_command_helper(const CMD *cmdList);
-// set env variable $? to whatever status is passed in
-void env_variable(int status);
 // handles built-in commands
 int built_in_command(const CMD *cmdList);
+// runs a built-in (or an in-process subshell) once its redirections are saved
+int built_in_dispatch(const CMD *cmdList);
 // handle fromType and toType for built-ins, only difference from other one is it returns instead of exit() because not in a child of a fork
 int redirect_stdin_builtin(const CMD *cmdList);
 int redirect_stdout_builtin(const CMD *cmdList);
+// handles exec commands
+int exec_command(const CMD *cmdList);
+// handles : (null) commands
+int colon_command(const CMD *cmdList);
+// handles echo commands
+int echo_command(const CMD *cmdList);
 // handles pushd commands
 int pushd_command(const CMD *cmdList);
 // handles popd commands
 int popd_command(const CMD *cmdList);
 
 
+// descriptors replaced by the redirections of the running built-in
+FdSave builtin_saved = {0, 0, NULL, NULL};
+
 // global linked list for pushd and popd
 typedef struct node {
     char* directory;
@@ -50,20 +73,9 @@ int process (const CMD *cmdList) {
 
 
     // reap zombies
-    int pid = 1;
-    int status;
-    while (pid > 0) {
-        pid = waitpid(-1, &status, WNOHANG);
-        if (pid > 0) {
-            int f = fprintf(stderr, "Completed: %d (%d)\n", pid, status);
-            // if fprintf() error
-            if (f < 0) {
-                int errno2 = errno;
-                perror("fprintf() error");
-                env_variable(f);
-                return errno2;
-            }
-        }
+    int r = reap_zombies();
+    if (r != 0) {
+        return r;
     }
 
     // check if passed null cmdList
@@ -71,14 +83,69 @@ int process (const CMD *cmdList) {
         return 0;
     }
 
+    // expand shielded words of a stage into a temporary copy
+    CMD *expanded = NULL;
+    if (cmdList->type == SIMPLE || cmdList->type == SUBCMD) {
+        expanded = expandCMD(cmdList);
+        if (expanded != NULL) {
+            cmdList = expanded;
+        }
+    }
+
     // var to hold return value of switch cases
     int ret_val;
+    // wall time and kind of a SIMPLE command, for shellstat
+    long start = stat_now();
+    bool external = false;
     switch(cmdList->type) {
         case SIMPLE:
-            if (strcmp(cmdList->argv[0], "cd") == 0 || strcmp(cmdList->argv[0], "pushd") == 0 || strcmp(cmdList->argv[0], "popd") == 0) {
+            if (strcmp(cmdList->argv[0], "cd") == 0 || strcmp(cmdList->argv[0], "pushd") == 0 || strcmp(cmdList->argv[0], "popd") == 0
+                    || strcmp(cmdList->argv[0], "echo") == 0 || strcmp(cmdList->argv[0], "pwd") == 0
+                    || strcmp(cmdList->argv[0], "shellstat") == 0 || strcmp(cmdList->argv[0], "cached") == 0) {
                 ret_val = built_in_command(cmdList);
                 break;
             }
+            if (strcmp(cmdList->argv[0], "jobs") == 0) {
+                ret_val = jobs_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "fg") == 0) {
+                ret_val = fg_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "bg") == 0) {
+                ret_val = bg_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "read") == 0) {
+                ret_val = read_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "exec") == 0) {
+                ret_val = exec_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], ":") == 0) {
+                ret_val = colon_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "taskset") == 0) {
+                ret_val = taskset_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "argsplit") == 0) {
+                ret_val = argsplit_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "timeout") == 0) {
+                ret_val = timeout_command(cmdList);
+                break;
+            }
+            if (strcmp(cmdList->argv[0], "coproc") == 0) {
+                ret_val = coproc_command(cmdList);
+                break;
+            }
+            external = true;
             ret_val = simple_command(cmdList);
             break;
         
@@ -114,6 +181,13 @@ int process (const CMD *cmdList) {
         default:
             break;
     }
+    if (cmdList->type == SIMPLE) {
+        stat_command(cmdList->argv[0], stat_now() - start);
+        if (!external) {
+            stat_add(ST_BUILTINS, 1);
+        }
+    }
+    freeExpanded(expanded);
 
 
     env_variable(ret_val);
@@ -123,13 +197,31 @@ int process (const CMD *cmdList) {
 
 int simple_command(const CMD *cmdList) {
 
-    int pid = fork();
+    // split an argument list too long for execve() if ARGSPLIT is set
+    if (argsplit_needed(cmdList)) {
+        char *keep = getenv("ARGSPLIT");
+        return argsplit_run(cmdList, atoi(keep), 1, 0);
+    }
+
+    // let the zygote helper fork and exec if one is running (it takes only
+    // stdin, stdout, and stderr, and cannot enforce a deadline)
+    int nRedir;
+    fdRedirs(cmdList, &nRedir);
+    if (zygote_active() && nRedir == 0 && !job_limited()) {
+        int z = zygote_spawn(cmdList);
+        if (z >= 0) {
+            return z;
+        }
+    }
+
+    int pid = job_fork(true);
 
     // fork failure returns -1
     if (pid < 0) {
         int errno2 = errno;
         // message to stderr
         perror("Fork failure");
+        job_done();
         // unsuccessful program execution
         return errno2;
     }
@@ -146,13 +238,17 @@ int simple_command(const CMD *cmdList) {
         redirect_stdin(cmdList);
         // handle toType
         redirect_stdout(cmdList);
+        // handle N>FILE, N>&M, etc.
+        redirect_fds(cmdList);
 
         // have the child call execvp to replace the currently executing code and data 
         // with an instance of the code and data of the new process, 
         // passing some command line arguments.
+        stat_add(ST_EXECS, 1);
         int x = execvp(cmdList->argv[0], cmdList->argv);
         if (x < 0) {
             int errno2 = errno;
+            stat_add(ST_EXEC_FAILS, 1);
             perror("execvp() error");
             exit(errno2);
         }
@@ -162,23 +258,10 @@ int simple_command(const CMD *cmdList) {
     }
     // parent
     else {
-        // wait for child to exit
+        // wait for child to exit (CTRL-C is ignored by the shell throughout)
         int child_status;
-
-        // ignore CTRL-C
-        if (signal(SIGINT, SIG_IGN) == SIG_ERR) {
-            int errno2 = errno;
-            perror("signal() error");  
-            return errno2;
-        }
-
-        waitpid(pid, &child_status, 0);
-
-        if (signal(SIGINT, SIG_DFL) == SIG_ERR) {
-            int errno2 = errno;
-            perror("signal() error");  
-            return errno2;
-        }
+        job_wait(pid, &child_status, NULL, cmdList);
+        job_done();
 
         // return child_status, should be 0 on successful child process
         return STATUS(child_status);
@@ -203,6 +286,7 @@ void redirect_stdin(const CMD *cmdList) {
                 perror("Open error");
                 exit(errno2);
             }
+            stat_add(ST_REDIRS, 1);
             // overwrite stdin to refer to new_stdin_fd (the opened fromFile)
             dup2(new_stdin_fd, STDIN_FILENO);
             // close opened file fd
@@ -223,6 +307,7 @@ void redirect_stdin(const CMD *cmdList) {
                 perror("Mkstemp() error");
                 exit(errno2);
             }
+            stat_add(ST_HEREDOCS, 1);
             
             int w = write(new_stdin_fd, cmdList->fromFile, strlen(cmdList->fromFile));
             // write the contents of HERE doc to the tmp file (new_stdin_fd)
@@ -276,6 +361,7 @@ void redirect_stdout(const CMD *cmdList) {
                 perror("Open error");
                 exit(errno2);
             }
+            stat_add(ST_REDIRS, 1);
             // overwrite stdout to refer to new_stdout_fd (the opened toFile)
             dup2(new_stdout_fd, STDOUT_FILENO);
             // close opened file fd
@@ -295,6 +381,7 @@ void redirect_stdout(const CMD *cmdList) {
                 perror("Open error");
                 exit(errno2);
             }
+            stat_add(ST_REDIRS, 1);
             // overwrite stdout to refer to new_stdout_fd (the opened toFile)
             dup2(new_stdout_fd, STDOUT_FILENO);
             // close opened file fd
@@ -309,6 +396,18 @@ void redirect_stdout(const CMD *cmdList) {
 // '|'
 int pipe_command(const CMD *cmdList) {
 
+    // built-in stages at the right end run as threads of one process
+    int k = thread_suffix(cmdList);
+    if (k > 0 && k == count_stages(cmdList)) {
+        return thread_command(cmdList);
+    }
+    if (k > 0) {
+        CMD *regrouped = thread_regroup(cmdList, k);
+        int ret_val = pipe_command(regrouped);
+        free(regrouped);
+        return ret_val;
+    }
+
     // pipefd[0] refers to the read end of the pipe
     // pipefd[1] refers to the write end of the pipe
     int pipefd[2];
@@ -320,14 +419,25 @@ int pipe_command(const CMD *cmdList) {
         perror("Pipe failure");
         return errno2;
     }
+    stat_add(ST_PIPES, 1);
 
-    // pipe left child node
-    int pid_left_child = fork();
+    // with PIPEPROF, a counting relay sits between the two children
+    int relay_pid = -1;
+    if (pipeprof_enabled()) {
+        relay_pid = pipeprof_start(pipefd, count_stages(cmdList->left));
+    }
+
+    // the NUMA node for PIPE_AFFINITY=compact is found here, not per stage
+    int node = pin_node();
+
+    // pipe left child node; the job's process group is the first stage's
+    int pid_left_child = job_fork(true);
 
     // fork failure returns -1
     if (pid_left_child < 0) {
         int errno2 = errno;
         perror("Fork failure");
+        job_done();
         return errno2;
     }
 
@@ -340,21 +450,26 @@ int pipe_command(const CMD *cmdList) {
         dup2(pipefd[1], STDOUT_FILENO);
         // close write end
         close(pipefd[1]);
+        // pin leftmost stage (inner stages are pinned by the recursive call)
+        if (cmdList->left->type != PIPE) {
+            pin_stage(0, node);
+        }
         // exit w/ status of recursive call because left child could be of any type
             // process() will call execvp() on cmdList->left
-        exit(process(cmdList->left));
+        exit(pipe_stage(cmdList->left));
     }
 
     // parent of left child's fork
     else {
         
         // fork again from parent
-        int pid_right_child = fork();    // pipe right child node
+        int pid_right_child = job_fork(true);    // pipe right child node
 
         // fork failure returns -1
         if (pid_right_child < 0) {
             int errno2 = errno;
             perror("Fork failure");
+            job_done();
             return errno2;
         }
 
@@ -366,8 +481,10 @@ int pipe_command(const CMD *cmdList) {
             dup2(pipefd[0], STDIN_FILENO);
             // close read end
             close(pipefd[0]);
+            // pin this stage; its index is the number of stages to its left
+            pin_stage(count_stages(cmdList->left), node);
             // exit w/ status of recursive call because right child could be of any type
-            exit(process(cmdList->right));
+            exit(pipe_stage(cmdList->right));
         }
 
         // parent of right child's fork
@@ -380,19 +497,19 @@ int pipe_command(const CMD *cmdList) {
             int left_child_status;
             int right_child_status;
 
-            if (signal(SIGINT, SIG_IGN) == SIG_ERR) {
-                int errno2 = errno;
-                perror("signal() error");  
-                return errno2;
-            }
-
-            waitpid(pid_left_child, &left_child_status, 0);
-            waitpid(pid_right_child, &right_child_status, 0);
-            
-            if (signal(SIGINT, SIG_DFL) == SIG_ERR) {
-                int errno2 = errno;
-                perror("signal() error");  
-                return errno2;
+            struct rusage left_usage;
+            struct rusage right_usage;
+            job_wait(pid_left_child, &left_child_status, &left_usage, cmdList);
+            job_wait(pid_right_child, &right_child_status, &right_usage, cmdList);
+            job_done();
+
+            if (relay_pid > 0) {
+                waitpid(relay_pid, NULL, 0);
+                // inner stages are reported by the recursive call
+                if (cmdList->left->type != PIPE) {
+                    pipeprof_stage(cmdList->left, 0, &left_usage);
+                }
+                pipeprof_stage(cmdList->right, count_stages(cmdList->left), &right_usage);
             }
 
             int left_status = STATUS(left_child_status);
@@ -423,6 +540,24 @@ int pipe_command(const CMD *cmdList) {
 }
 
 
+int pipe_stage(const CMD *cmdList) {
+    // tee runs in the stage's own process instead of exec'ing /usr/bin/tee
+    if (cmdList->type == SIMPLE && strcmp(cmdList->argv[0], "tee") == 0) {
+        CMD *expanded = expandCMD(cmdList);
+        if (expanded != NULL) {
+            cmdList = expanded;
+        }
+        redirect_stdin(cmdList);
+        redirect_stdout(cmdList);
+        redirect_fds(cmdList);
+        int ret_val = tee_command(cmdList);
+        freeExpanded(expanded);
+        return ret_val;
+    }
+    return process(cmdList);
+}
+
+
 // '&&'
 int and_command(const CMD *cmdList) {
     // A && B; First process A. If it returns false (non-zero), skip B.
@@ -462,13 +597,23 @@ int or_command(const CMD *cmdList) {
 
 
 int sub_command(const CMD *cmdList) {
+    // a body of built-ins runs here, with the shell's state put back after
+    if (subshell_inline(cmdList->left)) {
+        Snapshot snap;
+        subshell_save(&snap);
+        int ret_val = built_in_command(cmdList);
+        subshell_restore(&snap);
+        return ret_val;
+    }
+
     // similar to simple command
-    int pid = fork();
+    int pid = job_fork(true);
 
     // fork failure returns -1
     if (pid < 0) {
         int errno2 = errno;
         perror("Fork failure");
+        job_done();
         return errno2;
     }
 
@@ -482,6 +627,7 @@ int sub_command(const CMD *cmdList) {
         // handle redirection
         redirect_stdin(cmdList);
         redirect_stdout(cmdList);
+        redirect_fds(cmdList);
 
         // In this case the subshell (simply a forked child shell) would recursively 
         // process the child command node (cmdList->left) and exit with its status
@@ -492,20 +638,9 @@ int sub_command(const CMD *cmdList) {
     else {
         // wait for child to exit
         int child_status;
+        job_wait(pid, &child_status, NULL, cmdList);
+        job_done();
 
-        if (signal(SIGINT, SIG_IGN) == SIG_ERR) {
-            int errno2 = errno;
-            perror("signal() error");  
-            return errno2;
-        }
-
-        waitpid(pid, &child_status, 0);
-
-        if (signal(SIGINT, SIG_DFL) == SIG_ERR) {
-            int errno2 = errno;
-            perror("signal() error");  
-            return errno2;
-        }
         // return child_status, should be 0 on successful child process
         return STATUS(child_status);
     }
@@ -626,11 +761,12 @@ int background_command_helper(const CMD *cmdList) {
     }
 
     else {
-        int pid = fork();
+        int pid = job_fork(false);
 
         if (pid < 0) {
             int errno2 = errno;
             perror("Fork failure");
+            job_done();
             env_variable(pid);
             return errno2;
         }
@@ -643,6 +779,8 @@ int background_command_helper(const CMD *cmdList) {
         // parent
         else {
             // do not waitpid for child 
+            job_background(pid, cmdList);
+            stat_add(ST_BG_LAUNCHED, 1);
             int f = fprintf(stderr, "Backgrounded: %d\n", pid);
             if (f < 0) {
                 int errno2 = errno;
@@ -659,6 +797,27 @@ int background_command_helper(const CMD *cmdList) {
 }
 
 
+int reap_zombies(void) {
+    int pid = 1;
+    int status;
+    while (pid > 0) {
+        pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            stat_add(ST_BG_REAPED, 1);
+            int f = fprintf(stderr, "Completed: %d (%d)\n", pid, status);
+            // if fprintf() error
+            if (f < 0) {
+                int errno2 = errno;
+                perror("fprintf() error");
+                env_variable(f);
+                return errno2;
+            }
+        }
+    }
+    return 0;
+}
+
+
 void env_variable(int status) {
     // to store last command's "printed" value
     char printed_value[10];
@@ -670,15 +829,141 @@ void env_variable(int status) {
 }
 
 
-int built_in_command(const CMD *cmdList) {
-    // will return 0 at end if successful through all code
-    int ret_val = 0;
+int exec_command(const CMD *cmdList) {
+    // assignments persist, as for cd
+    for (int i = 0; i < cmdList->nLocal; i++) {
+        setenv(cmdList->locVar[i], cmdList->locVal[i], 1);
+    }
+
+    // redirections rewire the shell's own descriptors for good; one that
+    // fails ends a subshell (whose redirections shield() puts here) rather
+    // than let the rest run with the wrong descriptors
+    fflush(stdout);
+    int x = redirect_stdin_builtin(cmdList);
+    if (x == 0) {
+        x = redirect_stdout_builtin(cmdList);
+    }
+    int nRedir;
+    const FdRedir *redirs = fdRedirs(cmdList, &nRedir);
+    if (x == 0 && nRedir > 0) {
+        x = fd_apply(redirs, nRedir, NULL);
+    }
+    if (x != 0) {
+        if (!job_shell()) {
+            exit(x);
+        }
+        return x;
+    }
+    if (cmdList->argc == 1) {
+        return 0;
+    }
+
+    // replace the shell with the command
+    job_signals();
+    stat_add(ST_EXECS, 1);
+    execvp(cmdList->argv[1], cmdList->argv + 1);
+    int errno2 = errno;
+    stat_add(ST_EXEC_FAILS, 1);
+    perror("execvp() error");
+    return errno2;
+}
+
+
+void redirect_fds(const CMD *cmdList) {
+    int nRedir;
+    const FdRedir *redirs = fdRedirs(cmdList, &nRedir);
+    if (nRedir > 0) {
+        int z = fd_apply(redirs, nRedir, NULL);
+        if (z != 0) {
+            exit(z);
+        }
+    }
+}
+
 
-    // set local vars
+int colon_command(const CMD *cmdList) {
+    // assignments persist, as for cd
     for (int i = 0; i < cmdList->nLocal; i++) {
         setenv(cmdList->locVar[i], cmdList->locVal[i], 1);
     }
 
+    // redirections only create or truncate files; stdio is left alone
+    int fd = -1;
+    if (cmdList->fromType == RED_IN) {
+        fd = open(cmdList->fromFile, O_RDONLY);
+    }
+    else if (cmdList->toType == RED_OUT) {
+        fd = open(cmdList->toFile, O_RDWR|O_CREAT|O_TRUNC, S_IRWXU);
+    }
+    else if (cmdList->toType == RED_OUT_APP) {
+        fd = open(cmdList->toFile, O_RDWR|O_CREAT|O_APPEND, S_IRWXU);
+    }
+    else {
+        return 0;
+    }
+    if (fd < 0) {
+        int errno2 = errno;
+        perror("Open error");
+        return errno2;
+    }
+    stat_add(ST_REDIRS, 1);
+    close(fd);
+    return 0;
+}
+
+
+int built_in_command(const CMD *cmdList) {
+    // keep the shell's stdin and stdout to restore after any redirection,
+    // out of the way of N>&M and not inherited by commands
+    fflush(stdout);
+    int saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+    int saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+
+    // assignments before a built-in hold only while it runs, except that
+    // those before cd, pushd, and popd persist, as they always have
+    bool keep = cmdList->type == SIMPLE && (strcmp(cmdList->argv[0], "cd") == 0
+            || strcmp(cmdList->argv[0], "pushd") == 0 || strcmp(cmdList->argv[0], "popd") == 0);
+    char *old[cmdList->nLocal + 1];
+    for (int i = 0; i < cmdList->nLocal; i++) {
+        char *value = getenv(cmdList->locVar[i]);
+        old[i] = (value != NULL) ? strdup(value) : NULL;
+        setenv(cmdList->locVar[i], cmdList->locVal[i], 1);
+    }
+
+    // built-ins in an in-process subshell nest inside its redirections
+    FdSave outer = builtin_saved;
+    builtin_saved = (FdSave) {0, 0, NULL, NULL};
+
+    int ret_val = built_in_dispatch(cmdList);
+
+    fflush(stdout);
+    for (int i = cmdList->nLocal - 1; i >= 0; i--) {
+        if (!keep && old[i] != NULL) {
+            setenv(cmdList->locVar[i], old[i], 1);
+        }
+        else if (!keep) {
+            unsetenv(cmdList->locVar[i]);
+        }
+        free(old[i]);
+    }
+    fd_undo(&builtin_saved);
+    builtin_saved = outer;
+    if (saved_stdin >= 0) {
+        dup2(saved_stdin, STDIN_FILENO);
+        close(saved_stdin);
+    }
+    if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+    return ret_val;
+}
+
+
+int built_in_dispatch(const CMD *cmdList) {
+    // will return 0 at end if successful through all code
+    int ret_val = 0;
+
     // handle fromType
     int x = redirect_stdin_builtin(cmdList);
     if (x != 0) {
@@ -691,6 +976,20 @@ int built_in_command(const CMD *cmdList) {
         int errno2 = errno;
         return errno2;
     }
+    // handle N>FILE, N>&M, etc.
+    int nRedir;
+    const FdRedir *redirs = fdRedirs(cmdList, &nRedir);
+    if (nRedir > 0) {
+        int z = fd_apply(redirs, nRedir, &builtin_saved);
+        if (z != 0) {
+            return z;
+        }
+    }
+
+    // in-process subshell
+    if (cmdList->type == SUBCMD) {
+        return process(cmdList->left);
+    }
 
     // check which built-in it is and change int case accordingly for switch()
     char* command = cmdList->argv[0];
@@ -705,6 +1004,18 @@ int built_in_command(const CMD *cmdList) {
     if (strcmp(command, "popd") == 0) {
         type = 3;
     }
+    if (strcmp(command, "echo") == 0) {
+        type = 4;
+    }
+    if (strcmp(command, "pwd") == 0) {
+        type = 5;
+    }
+    if (strcmp(command, "shellstat") == 0) {
+        type = 6;
+    }
+    if (strcmp(command, "cached") == 0) {
+        type = 7;
+    }
 
     switch(type) {
         // cd
@@ -767,6 +1078,35 @@ int built_in_command(const CMD *cmdList) {
             }
             break;
 
+        // echo
+        case 4:
+            ret_val = echo_command(cmdList);
+            break;
+
+        // pwd
+        case 5:
+        {
+            char *current_directory = get_current_dir_name();
+            if (current_directory == NULL) {
+                int errno2 = errno;
+                perror("getcwd() error");
+                return errno2;
+            }
+            printf("%s\n", current_directory);
+            free(current_directory);
+            break;
+        }
+
+        // shellstat
+        case 6:
+            ret_val = shellstat_command(cmdList);
+            break;
+
+        // cached
+        case 7:
+            ret_val = cached_command(cmdList);
+            break;
+
         default:
             break;
     }
@@ -790,6 +1130,7 @@ int redirect_stdin_builtin(const CMD *cmdList) {
                 perror("Open error");
                 return errno2;
             }
+            stat_add(ST_REDIRS, 1);
             // overwrite stdin to refer to new_stdin_fd (the opened fromFile)
             dup2(new_stdin_fd, STDIN_FILENO);
             // close opened file fd
@@ -810,6 +1151,7 @@ int redirect_stdin_builtin(const CMD *cmdList) {
                 perror("Mkstemp() error");
                 return errno2;
             }
+            stat_add(ST_HEREDOCS, 1);
             
             int w = write(new_stdin_fd, cmdList->fromFile, strlen(cmdList->fromFile));
             // write the contents of HERE doc to the tmp file (new_stdin_fd)
@@ -823,15 +1165,16 @@ int redirect_stdin_builtin(const CMD *cmdList) {
             close(new_stdin_fd);
             // reopen tmp file in read only mode
             int o = open(tmp, O_RDONLY);
+            unlink(tmp);
             if (o < 0) {
                 int errno2 = errno;
                 perror("Open error");
                 return errno2;
             }
-            // overwrite stdin to refer to new_stdin_fd (the opened fromFile)
-            dup2(new_stdin_fd, STDIN_FILENO);
+            // overwrite stdin to refer to o (the reopened tmp file)
+            dup2(o, STDIN_FILENO);
             // close tmp file fd
-            close(new_stdin_fd);
+            close(o);
             break;
         }
 
@@ -862,6 +1205,7 @@ int redirect_stdout_builtin(const CMD *cmdList) {
                 perror("Open error");
                 return errno2;
             }
+            stat_add(ST_REDIRS, 1);
             // overwrite stdout to refer to new_stdout_fd (the opened toFile)
             dup2(new_stdout_fd, STDOUT_FILENO);
             // close opened file fd
@@ -881,6 +1225,7 @@ int redirect_stdout_builtin(const CMD *cmdList) {
                 perror("Open error");
                 return errno2;
             }
+            stat_add(ST_REDIRS, 1);
             // overwrite stdout to refer to new_stdout_fd (the opened toFile)
             dup2(new_stdout_fd, STDOUT_FILENO);
             // close opened file fd
@@ -891,6 +1236,33 @@ int redirect_stdout_builtin(const CMD *cmdList) {
     return 0;
 }
 
+int echo_command(const CMD *cmdList) {
+    // "echo -n ..." omits the newline
+    int i = 1;
+    bool newline = true;
+    if (cmdList->argc > 1 && strcmp(cmdList->argv[1], "-n") == 0) {
+        newline = false;
+        i++;
+    }
+
+    for (int first = i; i < cmdList->argc; i++) {
+        if (i > first) {
+            putchar(' ');
+        }
+        fputs(cmdList->argv[i], stdout);
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    if (fflush(stdout) == EOF) {
+        int errno2 = errno;
+        perror("echo");
+        return errno2;
+    }
+    return 0;
+}
+
+
 int pushd_command(const CMD *cmdList) {
     // set node
     Node *node = malloc(sizeof(Node));
@@ -998,4 +1370,29 @@ int popd_command(const CMD *cmdList) {
     free(popped_node);
 
     return 0;
-}
\ No newline at end of file
+}
+
+
+void *dirs_save(void) {
+    Node *copy = NULL;
+    Node **tail = &copy;
+    for (Node *tmp = head; tmp != NULL; tmp = tmp->next) {
+        Node *node = malloc(sizeof(Node));
+        node->directory = strdup(tmp->directory);
+        node->next = NULL;
+        *tail = node;
+        tail = &node->next;
+    }
+    return copy;
+}
+
+
+void dirs_restore(void *saved) {
+    while (head != NULL) {
+        Node *next = head->next;
+        free(head->directory);
+        free(head);
+        head = next;
+    }
+    head = saved;
+}
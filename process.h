@@ -31,3 +31,37 @@
 
 // Execute command list CMDLIST and return status of last command executed
 int process (const CMD *cmdList);
+
+// Reap finished background children, reporting each on stderr; return 0 or
+// errno if the report could not be written
+int reap_zombies (void);
+
+// Run the and-or list CMDLIST in a background child and return 0 (or errno)
+int background_command_helper (const CMD *cmdList);
+
+// Fork and exec the expanded SIMPLE command CMDLIST; return its status
+int simple_command (const CMD *cmdList);
+
+// Set $? to STATUS
+void env_variable (int status);
+
+// Read, parse, and execute command lines from stdin until end of file,
+// prompting for each if PROMPT is true; return status of last command
+int run_lines (bool prompt);
+
+// Execute the parsed command line CMD as run_lines() does, without freeing it
+void run_line (CMD *cmd);
+
+// Redirect stdin (stdout) of the calling process as CMDLIST specifies; exit
+// on error (use only in a child)
+void redirect_stdin (const CMD *cmdList);
+void redirect_stdout (const CMD *cmdList);
+
+// Apply the descriptor redirections of CMDLIST (see fdredir.h) to the calling
+// process; exit on error (use only in a child)
+void redirect_fds (const CMD *cmdList);
+
+// Return a copy of the pushd/popd directory stack, to be handed back to
+// dirs_restore(), which replaces the stack with it
+void *dirs_save (void);
+void dirs_restore (void *saved);
@@ -0,0 +1,303 @@
+#include "read.h"
+#include "shellstat.h"
+#include "expand.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// bytes read at once from a regular file or a buffered pipe
+#define READ_BLOCK (64 * 1024)
+
+
+// source of bytes for one read
+typedef struct input {
+    int fd;             // file descriptor
+    char *buf;          // bytes read but not yet used are buf[pos..n)
+    int pos, n;
+    int size;           // bytes to ask read() for
+    bool seek;          // lseek() back over unused bytes when done
+} Input;
+
+// buffer kept between read -b calls on the same pipe or terminal
+static struct {
+    dev_t dev;
+    ino_t ino;
+    char buf[READ_BLOCK];
+    int pos, n;
+} kept;
+
+// record being read: bytes and whether each was quoted with a backslash
+typedef struct record {
+    char *s;
+    bool *quoted;
+    int n, size;
+} Record;
+
+
+// FUNCTION DECLARATIONS
+// return next byte of in, or -1 at end of file or on error
+static int next_byte(Input *in);
+// append c to rec
+static void put_byte(Record *rec, char c, bool quoted);
+// return true if c is an unquoted field separator
+static bool is_ifs(const char *ifs, char c, bool quoted);
+// return true if rec->s[j] is an unquoted white-space separator
+static bool is_white(const Record *rec, const char *ifs, int j);
+// assign the fields of rec to names[0..nName)
+static void assign_fields(Record *rec, const char *ifs, char **names, int nName);
+// return IFS from the local assignments of cmdList or the environment
+static const char *get_ifs(const CMD *cmdList);
+// return fd for the input redirection of cmdList, or -1 if none (-2 on error)
+static int open_input(const CMD *cmdList);
+
+
+static int next_byte(Input *in) {
+    if (in->pos == in->n) {
+        int n;
+        do {
+            n = read(in->fd, in->buf, in->size);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            if (n < 0) {
+                perror("read");
+            }
+            return -1;
+        }
+        in->pos = 0;
+        in->n = n;
+    }
+    return (unsigned char) in->buf[in->pos++];
+}
+
+
+static void put_byte(Record *rec, char c, bool quoted) {
+    if (rec->n == rec->size) {
+        rec->size = rec->size ? 2 * rec->size : 128;
+        REALLOC(rec->s, rec->size);
+        REALLOC(rec->quoted, rec->size);
+    }
+    rec->s[rec->n] = c;
+    rec->quoted[rec->n] = quoted;
+    rec->n++;
+}
+
+
+static bool is_ifs(const char *ifs, char c, bool quoted) {
+    return !quoted && c != '\0' && strchr(ifs, c) != NULL;
+}
+
+
+static bool is_white(const Record *rec, const char *ifs, int j) {
+    return is_ifs(ifs, rec->s[j], rec->quoted[j]) && strchr(" \t\n", rec->s[j]);
+}
+
+
+static void assign_fields(Record *rec, const char *ifs, char **names, int nName) {
+    char *value = malloc(rec->n + 1);
+    int i = 0;
+
+    // separators that are white space are trimmed and run together
+    while (i < rec->n && is_white(rec, ifs, i)) {
+        i++;
+    }
+
+    for (int v = 0; v < nName; v++) {
+        int n = 0;
+        if (v == nName - 1) {
+            // last name gets the rest, less trailing white space
+            int end = rec->n;
+            while (end > i && is_white(rec, ifs, end - 1)) {
+                end--;
+            }
+            for ( ; i < end; i++) {
+                value[n++] = rec->s[i];
+            }
+        }
+        else {
+            for ( ; i < rec->n && !is_ifs(ifs, rec->s[i], rec->quoted[i]); i++) {
+                value[n++] = rec->s[i];
+            }
+            // skip one separator with the white space around it
+            while (i < rec->n && is_white(rec, ifs, i)) {
+                i++;
+            }
+            if (i < rec->n && is_ifs(ifs, rec->s[i], rec->quoted[i])) {
+                i++;
+                while (i < rec->n && is_white(rec, ifs, i)) {
+                    i++;
+                }
+            }
+        }
+        value[n] = '\0';
+        setenv(names[v], value, 1);
+    }
+    free(value);
+}
+
+
+static const char *get_ifs(const CMD *cmdList) {
+    for (int i = 0; i < cmdList->nLocal; i++) {
+        if (strcmp(cmdList->locVar[i], "IFS") == 0) {
+            return cmdList->locVal[i];
+        }
+    }
+    const char *ifs = getenv("IFS");
+    return (ifs != NULL) ? ifs : " \t\n";
+}
+
+
+static int open_input(const CMD *cmdList) {
+    if (cmdList->fromType == RED_IN) {
+        int fd = open(cmdList->fromFile, O_RDONLY);
+        if (fd < 0) {
+            perror("Open error");
+            return -2;
+        }
+        stat_add(ST_REDIRS, 1);
+        return fd;
+    }
+
+    // a here document becomes an anonymous regular file
+    if (cmdList->fromType == RED_IN_HERE) {
+        int fd = memfd_create("here", MFD_CLOEXEC);
+        size_t len = strlen(cmdList->fromFile);
+        if (fd < 0 || write(fd, cmdList->fromFile, len) != (ssize_t) len) {
+            perror("Here document");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -2;
+        }
+        stat_add(ST_HEREDOCS, 1);
+        lseek(fd, 0, SEEK_SET);
+        return fd;
+    }
+    return -1;
+}
+
+
+int read_command(const CMD *cmdList) {
+    bool raw = false;
+    bool buffer = false;
+    int delim = '\n';
+
+    // options
+    int i = 1;
+    for ( ; i < cmdList->argc && cmdList->argv[i][0] == '-' && cmdList->argv[i][1]; i++) {
+        if (strcmp(cmdList->argv[i], "-r") == 0) {
+            raw = true;
+        }
+        else if (strcmp(cmdList->argv[i], "-b") == 0) {
+            buffer = true;
+        }
+        else if (strcmp(cmdList->argv[i], "-d") == 0 && i + 1 < cmdList->argc) {
+            delim = (unsigned char) cmdList->argv[++i][0];
+        }
+        else {
+            fprintf(stderr, "usage: read [-r] [-b] [-d DELIM] [NAME]...\n");
+            return 2;
+        }
+    }
+    char *reply[] = {"REPLY"};
+    char **names = (i < cmdList->argc) ? cmdList->argv + i : reply;
+    int nName = (i < cmdList->argc) ? cmdList->argc - i : 1;
+
+    int fd = open_input(cmdList);
+    if (fd == -2) {
+        return 1;
+    }
+    bool opened = (fd >= 0);
+
+    // N<FILE, <&M, etc. hold for the read, after < as in a child
+    int nRedir;
+    const FdRedir *redirs = fdRedirs(cmdList, &nRedir);
+    FdSave saved = {0, 0, NULL, NULL};
+    if (nRedir > 0 && fd_apply(redirs, nRedir, &saved) != 0) {
+        fd_undo(&saved);
+        if (opened) {
+            close(fd);
+        }
+        return 1;
+    }
+    for (int j = 0; j < nRedir && opened; j++) {
+        if (redirs[j].fd == STDIN_FILENO) {
+            close(fd);
+            opened = false;
+        }
+    }
+    if (!opened) {
+        fd = STDIN_FILENO;
+    }
+
+    // choose how to read: blocks with lseek() back, kept blocks, or bytes
+    char byte;
+    Input in = {fd, &byte, 0, 0, 1, false};
+    struct stat st;
+    bool regular = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+    if (regular && lseek(fd, 0, SEEK_CUR) >= 0) {
+        in.buf = malloc(READ_BLOCK);
+        in.size = READ_BLOCK;
+        in.seek = true;
+    }
+    else if (buffer && !opened) {
+        if (kept.dev != st.st_dev || kept.ino != st.st_ino) {
+            kept.dev = st.st_dev;
+            kept.ino = st.st_ino;
+            kept.pos = kept.n = 0;
+        }
+        in.buf = kept.buf;
+        in.pos = kept.pos;
+        in.n = kept.n;
+        in.size = READ_BLOCK;
+    }
+
+    // read up to the delimiter
+    Record rec = {NULL, NULL, 0, 0};
+    int c;
+    int status = 1;
+    while ((c = next_byte(&in)) >= 0) {
+        if (c == delim) {
+            status = 0;
+            break;
+        }
+        if (c == '\\' && !raw) {
+            c = next_byte(&in);
+            if (c < 0) {
+                break;
+            }
+            if (c != delim) {
+                put_byte(&rec, c, true);
+            }
+            continue;
+        }
+        put_byte(&rec, c, false);
+    }
+
+    // give back what was read past the record
+    if (in.seek) {
+        if (in.pos < in.n) {
+            lseek(fd, in.pos - in.n, SEEK_CUR);
+        }
+        free(in.buf);
+    }
+    else if (in.buf == kept.buf) {
+        kept.pos = in.pos;
+        kept.n = in.n;
+    }
+    if (opened) {
+        close(fd);
+    }
+    fd_undo(&saved);
+
+    // with no NAME, REPLY gets the record as is
+    if (names == reply) {
+        put_byte(&rec, '\0', false);
+        setenv("REPLY", rec.s, 1);
+    }
+    else {
+        assign_fields(&rec, get_ifs(cmdList), names, nName);
+    }
+    free(rec.s);
+    free(rec.quoted);
+    return status;
+}
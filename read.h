@@ -0,0 +1,26 @@
+// read.h
+//
+// Built-in "read [-r] [-b] [-d DELIM] [NAME]..." reads one record from stdin
+// (or the file, here document, or descriptor, as in <&N, it is redirected
+// from), splits it into fields at the characters in IFS (default space, tab,
+// newline), and assigns them to the NAMEs, the last NAME getting the rest of
+// the record.  With no NAME the whole record is assigned to REPLY.  The
+// status is 0, or 1 at end of file.
+//
+//   -r        A backslash is an ordinary character (otherwise it quotes the
+//             next character, and removes it if it is the delimiter)
+//   -d DELIM  Records end at the first character of DELIM (newline by
+//             default; NUL if DELIM is empty)
+//   -b        Buffer a pipe or terminal even though bytes read ahead are
+//             lost to other readers; the buffer is kept for the next read -b
+//             from the same file
+//
+// Input that is a regular file is read in large blocks, and the offset is
+// moved back to the end of the record afterwards, so that the next reader
+// starts where the record ended.  Other input is read one byte at a time
+// unless -b is given.
+
+#include "process.h"
+
+// Run the read built-in described by CMDLIST and return its status
+int read_command (const CMD *cmdList);
@@ -0,0 +1,749 @@
+#include "script.h"
+#include "expand.h"
+#include "lex.h"
+#include "heredoc.h"
+#include "shellstat.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define PACK_MAGIC "bshcmd\n"
+#define FORMAT_VERSION 3         // 2: words shield $NAME and ${...}
+                                 // 3: quoted constructs are marked
+
+#define CACHE_MAGIC "bshscr\n"
+
+// bits added to the type byte of a node that has a left or right child
+#define HAS_LEFT  0x40
+#define HAS_RIGHT 0x80
+
+
+// start of a block made by packCMD()
+typedef struct packHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nRoot;             // lines
+    uint32_t nNode;             // CMD structures
+    uint32_t nPtr;              // entries of their argv[], locVar[], locVal[]
+    uint32_t nCode;             // bytes of trees
+    uint32_t nString;           // bytes of strings
+} PackHeader;
+
+// start of a cache entry; the block follows
+typedef struct cacheHeader {
+    char magic[8];
+    int64_t size;               // of the script
+    int64_t sec, nsec;          // its modification time
+    uint64_t hash;              // hash_text() of its contents
+    uint64_t check;             // hash_text() of the block
+} CacheHeader;
+
+// block being built by packCMD()
+typedef struct packer {
+    unsigned char *code;
+    size_t nCode, sizeCode;
+    char *string;
+    size_t nString, sizeString;
+    uint32_t *slot;             // hash table of string offsets + 1
+    size_t nSlot, nUsed;
+    uint32_t nNode, nPtr;
+} Packer;
+
+// position in the trees of a block being decoded
+typedef struct reader {
+    const unsigned char *p, *end;
+    const char *string;
+    uint32_t nString;
+    bool bad;                   // set on any error
+} Reader;
+
+// CMD structures and pointers not yet used by unpackCMD()
+typedef struct store {
+    CMD *node, *nodeEnd;
+    char **ptr, **ptrEnd;
+} Store;
+
+// here document being expanded while its line runs
+typedef struct doc {
+    CMD *cmd;
+    char *text;                 // as written
+} Doc;
+
+static const char *typeName[] = {
+    [SIMPLE] = "SIMPLE", [PIPE] = "PIPE", [SEP_AND] = "SEP_AND",
+    [SEP_OR] = "SEP_OR", [SEP_END] = "SEP_END", [SEP_BG] = "SEP_BG",
+    [NONE] = "NONE", [ERROR] = "ERROR", [SUBCMD] = "SUBCMD",
+};
+
+static const char *redirName[] = {
+    [RED_IN] = "<",   [RED_IN_HERE] = "<<",
+    [RED_OUT] = ">",  [RED_OUT_APP] = ">>",  [RED_OUT_ERR] = "&>",
+    [RED_ERR] = "2>", [RED_ERR_APP] = "2>>",
+};
+
+
+// FUNCTION DECLARATIONS
+// return the FNV-1a hash of the n bytes at s
+static uint64_t hash_text(const char *s, size_t n);
+// append byte b to p's trees
+static void put_byte(Packer *p, unsigned b);
+// append x to p's trees as a LEB128 varint
+static void put_num(Packer *p, uint32_t x);
+// return the offset of string s in p's table, adding it if needed
+static uint32_t pack_string(Packer *p, const char *s);
+// append tree c to p's trees
+static void pack_node(Packer *p, const CMD *c);
+// check the header of the size bytes at block and set r to its trees;
+// return the header, or NULL if invalid
+static const PackHeader *open_block(const void *block, size_t size, Reader *r);
+// return the next byte of r
+static unsigned get_byte(Reader *r);
+// return the next varint of r
+static uint32_t get_num(Reader *r);
+// return the string whose offset is the next varint of r ("" if bad)
+static char *get_string(Reader *r);
+// return the string whose offset + 1 is the next varint of r, or NULL
+static char *get_file(Reader *r);
+// decode the next tree of r into structures taken from s
+static CMD *unpack_node(Reader *r, Store *s);
+// write the next tree of r as JSON
+static void json_node(Reader *r);
+// write s to stdout as a JSON string
+static void json_string(const char *s);
+// write a redirection of type t to file as JSON (if t is not NONE)
+static void json_redir(const char *key, int t, const char *file);
+// return the malloc()-ed name of the cache entry for path, or NULL
+static char *cache_name(const char *path);
+// return the malloc()-ed contents of fd (NUL-terminated), length in *len
+static char *read_all(int fd, size_t *len);
+// return the commands cached in name for the script fd with status st,
+// or NULL; store the mapping in *map and *mapLen and the number in *n
+static CMD **cache_load(const char *name, int fd, const struct stat *st,
+                       void **map, size_t *mapLen, int *n);
+// store the block of size bytes as the cache entry name
+static void cache_store(const char *name, const struct stat *st, uint64_t hash,
+                        const void *block, size_t size);
+// parse each line of the len bytes at text; set *ok false on any error
+static CMD **compile_script(const char *text, size_t len, int *n, bool *ok);
+// add the here documents of tree c to docs
+static void find_docs(CMD *c, Doc **docs, int *nDocs);
+// run the commands cmd[0..n) and return the status of the last
+static int run_commands(CMD **cmd, int n);
+
+
+static uint64_t hash_text(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (unsigned char) s[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+
+static void put_byte(Packer *p, unsigned b) {
+    if (p->nCode == p->sizeCode) {
+        p->sizeCode = p->sizeCode ? 2 * p->sizeCode : 4096;
+        REALLOC(p->code, p->sizeCode);
+    }
+    p->code[p->nCode++] = b;
+}
+
+
+static void put_num(Packer *p, uint32_t x) {
+    for ( ; x >= 0x80; x >>= 7) {
+        put_byte(p, (x & 0x7f) | 0x80);
+    }
+    put_byte(p, x);
+}
+
+
+static uint32_t pack_string(Packer *p, const char *s) {
+    size_t len = strlen(s);
+    if (2 * (p->nUsed + 1) > p->nSlot) {
+        // rebuild the table at twice the size
+        size_t nSlot = p->nSlot ? 2 * p->nSlot : 1024;
+        uint32_t *slot = calloc(nSlot, sizeof(uint32_t));
+        for (size_t i = 0; i < p->nSlot; i++) {
+            if (p->slot[i] != 0) {
+                const char *t = p->string + p->slot[i] - 1;
+                size_t h = hash_text(t, strlen(t)) & (nSlot - 1);
+                while (slot[h] != 0) {
+                    h = (h + 1) & (nSlot - 1);
+                }
+                slot[h] = p->slot[i];
+            }
+        }
+        free(p->slot);
+        p->slot = slot;
+        p->nSlot = nSlot;
+    }
+
+    size_t h = hash_text(s, len) & (p->nSlot - 1);
+    for ( ; p->slot[h] != 0; h = (h + 1) & (p->nSlot - 1)) {
+        if (strcmp(p->string + p->slot[h] - 1, s) == 0) {
+            return p->slot[h] - 1;
+        }
+    }
+
+    if (p->nString + len + 1 > p->sizeString) {
+        p->sizeString = 2 * (p->nString + len + 1);
+        REALLOC(p->string, p->sizeString);
+    }
+    uint32_t offset = p->nString;
+    memcpy(p->string + offset, s, len + 1);
+    p->nString += len + 1;
+    p->slot[h] = offset + 1;
+    p->nUsed++;
+    return offset;
+}
+
+
+static void pack_node(Packer *p, const CMD *c) {
+    put_byte(p, c->type | (c->left ? HAS_LEFT : 0) | (c->right ? HAS_RIGHT : 0));
+    put_byte(p, c->fromType);
+    put_byte(p, c->toType);
+    put_byte(p, c->errType);
+    put_num(p, c->argc);
+    put_num(p, c->nLocal);
+    for (int j = 0; j < c->argc; j++) {
+        put_num(p, pack_string(p, c->argv[j]));
+    }
+    for (int j = 0; j < c->nLocal; j++) {
+        put_num(p, pack_string(p, c->locVar[j]));
+        put_num(p, pack_string(p, c->locVal[j]));
+    }
+    put_num(p, c->fromFile ? pack_string(p, c->fromFile) + 1 : 0);
+    put_num(p, c->toFile ? pack_string(p, c->toFile) + 1 : 0);
+    put_num(p, c->errFile ? pack_string(p, c->errFile) + 1 : 0);
+    p->nNode++;
+    p->nPtr += c->argc + 1 + 2 * c->nLocal;
+
+    if (c->left) {
+        pack_node(p, c->left);
+    }
+    if (c->right) {
+        pack_node(p, c->right);
+    }
+}
+
+
+void *packCMD(CMD **cmd, int n, size_t *size) {
+    Packer p;
+    memset(&p, 0, sizeof(p));
+    for (int i = 0; i < n; i++) {
+        put_byte(&p, cmd[i] != NULL);
+        if (cmd[i] != NULL) {
+            pack_node(&p, cmd[i]);
+        }
+    }
+
+    PackHeader h = {PACK_MAGIC, FORMAT_VERSION, n, p.nNode, p.nPtr, p.nCode, p.nString};
+    *size = sizeof(h) + p.nCode + p.nString;
+    char *block = malloc(*size);
+    memcpy(block, &h, sizeof(h));
+    if (p.nCode > 0) {
+        memcpy(block + sizeof(h), p.code, p.nCode);
+    }
+    if (p.nString > 0) {
+        memcpy(block + sizeof(h) + p.nCode, p.string, p.nString);
+    }
+
+    free(p.code);
+    free(p.string);
+    free(p.slot);
+    return block;
+}
+
+
+static const PackHeader *open_block(const void *block, size_t size, Reader *r) {
+    const PackHeader *h = block;
+    if (size < sizeof(*h) || memcmp(h->magic, PACK_MAGIC, 8) != 0
+            || h->version != FORMAT_VERSION
+            || size != sizeof(*h) + (size_t) h->nCode + h->nString) {
+        return NULL;
+    }
+    r->p = (const unsigned char *) (h + 1);
+    r->end = r->p + h->nCode;
+    r->string = (const char *) r->end;
+    r->nString = h->nString;
+    r->bad = h->nString > 0 && r->string[h->nString - 1] != '\0';
+    return r->bad ? NULL : h;
+}
+
+
+static unsigned get_byte(Reader *r) {
+    if (r->p == r->end) {
+        r->bad = true;
+        return 0;
+    }
+    return *r->p++;
+}
+
+
+static uint32_t get_num(Reader *r) {
+    uint32_t x = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        unsigned b = get_byte(r);
+        x |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return x;
+        }
+    }
+    r->bad = true;
+    return 0;
+}
+
+
+static char *get_string(Reader *r) {
+    uint32_t offset = get_num(r);
+    if (offset >= r->nString) {
+        r->bad = true;
+        return "";
+    }
+    return (char *) r->string + offset;
+}
+
+
+static char *get_file(Reader *r) {
+    uint32_t offset = get_num(r);
+    if (offset == 0 || offset > r->nString) {
+        r->bad = r->bad || offset != 0;
+        return NULL;
+    }
+    return (char *) r->string + offset - 1;
+}
+
+
+static CMD *unpack_node(Reader *r, Store *s) {
+    unsigned type = get_byte(r);
+    if (r->bad || s->node == s->nodeEnd) {
+        r->bad = true;
+        return NULL;
+    }
+    CMD *c = s->node++;
+    c->type = type & ~(HAS_LEFT|HAS_RIGHT);
+    c->fromType = get_byte(r);
+    c->toType = get_byte(r);
+    c->errType = get_byte(r);
+    uint32_t argc = get_num(r);
+    uint32_t nLocal = get_num(r);
+    if (r->bad || (size_t) argc + 1 + 2 * (size_t) nLocal > (size_t) (s->ptrEnd - s->ptr)) {
+        r->bad = true;
+        return NULL;
+    }
+
+    c->argc = argc;
+    c->argv = s->ptr;
+    for (uint32_t j = 0; j < argc; j++) {
+        c->argv[j] = get_string(r);
+    }
+    c->argv[argc] = NULL;
+    s->ptr += argc + 1;
+    c->nLocal = nLocal;
+    c->locVar = c->locVal = NULL;
+    if (nLocal > 0) {
+        c->locVar = s->ptr;
+        c->locVal = s->ptr + nLocal;
+        for (uint32_t j = 0; j < nLocal; j++) {
+            c->locVar[j] = get_string(r);
+            c->locVal[j] = get_string(r);
+        }
+        s->ptr += 2 * nLocal;
+    }
+    c->fromFile = get_file(r);
+    c->toFile = get_file(r);
+    c->errFile = get_file(r);
+
+    c->left = (type & HAS_LEFT) ? unpack_node(r, s) : NULL;
+    c->right = (type & HAS_RIGHT) ? unpack_node(r, s) : NULL;
+    return c;
+}
+
+
+CMD **unpackCMD(const void *block, size_t size, int *n) {
+    Reader r;
+    const PackHeader *h = open_block(block, size, &r);
+    if (h == NULL) {
+        return NULL;
+    }
+
+    // roots, then nodes, then argv[], locVar[], and locVal[] of each node
+    CMD **root = malloc(h->nRoot * sizeof(CMD *) + h->nNode * sizeof(CMD)
+                        + h->nPtr * sizeof(char *) + 1);
+    Store s;
+    s.node = (CMD *) (root + h->nRoot);
+    s.nodeEnd = s.node + h->nNode;
+    s.ptr = (char **) s.nodeEnd;
+    s.ptrEnd = s.ptr + h->nPtr;
+    for (uint32_t i = 0; i < h->nRoot && !r.bad; i++) {
+        root[i] = get_byte(&r) ? unpack_node(&r, &s) : NULL;
+    }
+    if (r.bad || r.p != r.end) {
+        free(root);
+        return NULL;
+    }
+    *n = h->nRoot;
+    return root;
+}
+
+
+static void json_string(const char *s) {
+    putchar('"');
+    for ( ; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        }
+        else if (c == '\n') {
+            fputs("\\n", stdout);
+        }
+        else if (c < 0x20) {
+            printf("\\u%04x", c);
+        }
+        else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+
+static void json_redir(const char *key, int t, const char *file) {
+    if (t == NONE) {
+        return;
+    }
+    printf(",\"%s\":{\"op\":", key);
+    json_string(t >= RED_IN && t <= RED_ERR_APP ? redirName[t] : "?");
+    if (file != NULL) {
+        fputs(t == RED_IN_HERE ? ",\"here\":" : ",\"file\":", stdout);
+        json_string(file);
+    }
+    putchar('}');
+}
+
+
+static void json_node(Reader *r) {
+    unsigned type = get_byte(r);
+    int fromType = get_byte(r);
+    int toType = get_byte(r);
+    int errType = get_byte(r);
+    uint32_t argc = get_num(r);
+    uint32_t nLocal = get_num(r);
+    unsigned t = type & ~(HAS_LEFT|HAS_RIGHT);
+
+    fputs("{\"type\":", stdout);
+    json_string(t <= SUBCMD && typeName[t] ? typeName[t] : "?");
+    if (t == SIMPLE) {
+        fputs(",\"argv\":[", stdout);
+        for (uint32_t j = 0; j < argc && !r->bad; j++) {
+            if (j > 0) {
+                putchar(',');
+            }
+            json_string(get_string(r));
+        }
+        putchar(']');
+    }
+    if (nLocal > 0) {
+        fputs(",\"locals\":{", stdout);
+        for (uint32_t j = 0; j < nLocal && !r->bad; j++) {
+            if (j > 0) {
+                putchar(',');
+            }
+            json_string(get_string(r));
+            putchar(':');
+            json_string(get_string(r));
+        }
+        putchar('}');
+    }
+    json_redir("stdin", fromType, get_file(r));
+    json_redir("stdout", toType, get_file(r));
+    char *errFile = get_file(r);
+    if (errType != RED_OUT_ERR) {
+        json_redir("stderr", errType, errFile);
+    }
+    if ((type & HAS_LEFT) && !r->bad) {
+        fputs(",\"left\":", stdout);
+        json_node(r);
+    }
+    if ((type & HAS_RIGHT) && !r->bad) {
+        fputs(",\"right\":", stdout);
+        json_node(r);
+    }
+    putchar('}');
+}
+
+
+void dumpJSON(CMD *cmd) {
+    size_t size;
+    void *block = packCMD(&cmd, 1, &size);
+    Reader r;
+    if (open_block(block, size, &r) != NULL && get_byte(&r)) {
+        json_node(&r);
+    }
+    else {
+        fputs("null", stdout);
+    }
+    putchar('\n');
+    fflush(stdout);
+    free(block);
+}
+
+
+static char *cache_name(const char *path) {
+    char *dir;
+    const char *env = getenv("SCRIPT_CACHE_DIR");
+    if (env != NULL && *env) {
+        dir = strdup(env);
+    }
+    else {
+        const char *home = getenv("HOME");
+        if (home == NULL || asprintf(&dir, "%s/.cache", home) < 0) {
+            return NULL;
+        }
+        mkdir(dir, 0700);
+        free(dir);
+        if (asprintf(&dir, "%s/.cache/bsh-scripts", home) < 0) {
+            return NULL;
+        }
+    }
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        free(dir);
+        return NULL;
+    }
+
+    char *full = realpath(path, NULL);
+    char *name = NULL;
+    if (full != NULL && asprintf(&name, "%s/%016llx", dir,
+                                 (unsigned long long) hash_text(full, strlen(full))) < 0) {
+        name = NULL;
+    }
+    free(full);
+    free(dir);
+    return name;
+}
+
+
+static char *read_all(int fd, size_t *len) {
+    size_t size = 4096;
+    char *text = malloc(size);
+    *len = 0;
+    ssize_t n;
+    while ((n = pread(fd, text + *len, size - *len - 1, *len)) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            free(text);
+            return NULL;
+        }
+        *len += n;
+        if (*len + 1 == size) {
+            size *= 2;
+            REALLOC(text, size);
+        }
+    }
+    text[*len] = '\0';
+    return text;
+}
+
+
+static CMD **cache_load(const char *name, int fd, const struct stat *st,
+                       void **map, size_t *mapLen, int *n) {
+    int cache = open(name, O_RDONLY|O_CLOEXEC);
+    if (cache < 0) {
+        return NULL;
+    }
+    struct stat cst;
+    if (fstat(cache, &cst) < 0 || cst.st_size < (off_t) sizeof(CacheHeader)) {
+        close(cache);
+        return NULL;
+    }
+    // private and writable, since the shell may treat the strings as its own
+    *mapLen = cst.st_size;
+    *map = mmap(NULL, *mapLen, PROT_READ|PROT_WRITE, MAP_PRIVATE, cache, 0);
+    close(cache);
+    if (*map == MAP_FAILED) {
+        *map = NULL;
+        return NULL;
+    }
+
+    const CacheHeader *h = *map;
+    bool valid = memcmp(h->magic, CACHE_MAGIC, 8) == 0 && h->size == st->st_size;
+    if (valid && (h->sec != st->st_mtim.tv_sec || h->nsec != st->st_mtim.tv_nsec)) {
+        // touched, but perhaps not changed
+        size_t len;
+        char *text = read_all(fd, &len);
+        valid = text != NULL && len == (size_t) h->size && hash_text(text, len) == h->hash;
+        free(text);
+    }
+    size_t size = *mapLen - sizeof(*h);
+    valid = valid && hash_text((const char *) (h + 1), size) == h->check;
+    CMD **cmd = valid ? unpackCMD(h + 1, size, n) : NULL;
+    if (cmd == NULL) {
+        munmap(*map, *mapLen);
+        *map = NULL;
+    }
+    return cmd;
+}
+
+
+static void cache_store(const char *name, const struct stat *st, uint64_t hash,
+                        const void *block, size_t size) {
+    CacheHeader h = {CACHE_MAGIC, st->st_size, st->st_mtim.tv_sec, st->st_mtim.tv_nsec, hash,
+                     hash_text(block, size)};
+    char *tmp;
+    if (asprintf(&tmp, "%s.XXXXXX", name) < 0) {
+        return;
+    }
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return;
+    }
+    if (write(fd, &h, sizeof(h)) == sizeof(h) && write(fd, block, size) == (ssize_t) size
+            && close(fd) == 0) {
+        if (rename(tmp, name) < 0) {
+            unlink(tmp);
+        }
+    }
+    else {
+        close(fd);
+        unlink(tmp);
+    }
+    free(tmp);
+}
+
+
+static CMD **compile_script(const char *text, size_t len, int *n, bool *ok) {
+    CMD **cmd = NULL;
+    int size = 0;
+    *n = 0;
+    *ok = true;
+
+    // here documents come from the script, and stay unexpanded until run
+    const char *next = text;
+    const char *end = text + len;
+    here_source(&next, end, false);
+    while (next < end) {
+        const char *nl = memchr(next, '\n', end - next);
+        size_t lineLen = nl ? nl + 1 - next : end - next;
+        char *line = strndup(next, lineLen);
+        next += lineLen;
+
+        long start = stat_now();
+        char *shielded = shield(line);
+        token *list = lexList(shielded);
+        free(shielded);
+        CMD *c = NULL;
+        if (list != NULL) {
+            if (getenv("DUMP_LIST")) {
+                dumpList(list);
+            }
+            c = parse(list);
+            freeLexList(list);
+            *ok = *ok && c != NULL;
+        }
+        else if (line[strspn(line, " \t\n\v\f\r")] != '\0') {
+            *ok = false;
+        }
+        stat_add(ST_PARSE_NS, stat_now() - start);
+        free(line);
+
+        if (*n == size) {
+            size = size ? 2 * size : 64;
+            REALLOC(cmd, size);
+        }
+        cmd[(*n)++] = c;
+    }
+    here_source(NULL, NULL, false);
+    return cmd;
+}
+
+
+static void find_docs(CMD *c, Doc **docs, int *nDocs) {
+    for ( ; c != NULL; c = c->left) {
+        if (c->fromType == RED_IN_HERE && c->fromFile != NULL) {
+            REALLOC(*docs, *nDocs + 1);
+            (*docs)[(*nDocs)++] = (Doc) {c, c->fromFile};
+        }
+        find_docs(c->right, docs, nDocs);
+    }
+}
+
+
+static int run_commands(CMD **cmd, int n) {
+    for (int i = 0; i < n; i++) {
+        if (cmd[i] == NULL) {
+            continue;
+        }
+        stat_add(ST_LINES, 1);
+
+        // expand here documents as if the line had just been read
+        Doc *docs = NULL;
+        int nDocs = 0;
+        find_docs(cmd[i], &docs, &nDocs);
+        for (int j = 0; j < nDocs; j++) {
+            docs[j].cmd->fromFile = here_expand(docs[j].text);
+        }
+        run_line(cmd[i]);
+        for (int j = 0; j < nDocs; j++) {
+            free(docs[j].cmd->fromFile);
+            docs[j].cmd->fromFile = docs[j].text;
+        }
+        free(docs);
+    }
+    return atoi(getenv("?"));
+}
+
+
+int run_script(const char *path) {
+    int fd = open(path, O_RDONLY|O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        int errno2 = errno;
+        perror(path);
+        return errno2;
+    }
+
+    char *name = getenv("SCRIPT_NOCACHE") ? NULL : cache_name(path);
+    void *map = NULL;
+    size_t mapLen = 0;
+    void *block = NULL;
+    int n = 0;
+    CMD **cmd = name ? cache_load(name, fd, &st, &map, &mapLen, &n) : NULL;
+    if (cmd == NULL) {
+        size_t len;
+        char *text = read_all(fd, &len);
+        if (text == NULL) {
+            int errno2 = errno;
+            perror(path);
+            close(fd);
+            free(name);
+            return errno2;
+        }
+        bool ok;
+        CMD **parsed = compile_script(text, len, &n, &ok);
+        size_t size;
+        block = packCMD(parsed, n, &size);
+        for (int i = 0; i < n; i++) {
+            freeCMD(parsed[i]);
+        }
+        free(parsed);
+        if (name != NULL && ok && len == (size_t) st.st_size) {
+            cache_store(name, &st, hash_text(text, len), block, size);
+        }
+        free(text);
+        cmd = unpackCMD(block, size, &n);
+    }
+    close(fd);
+    free(name);
+
+    int status = run_commands(cmd, n);
+    free(cmd);
+    free(block);
+    if (map != NULL) {
+        munmap(map, mapLen);
+    }
+    return status;
+}
@@ -0,0 +1,40 @@
+// script.h
+//
+// Script mode and compiled scripts.  "Bash SCRIPT" runs the lines of SCRIPT
+// as run_lines() would, but parses the whole file first and keeps the parsed
+// form in a cache, so that later runs of an unchanged script map it with
+// mmap() instead of tokenizing and parsing again.  Here documents are kept
+// as written and expanded (see heredoc.h) just before their line runs.
+//
+// Cache entries live in $SCRIPT_CACHE_DIR (default $HOME/.cache/bsh-scripts),
+// one file per script named by a hash of its absolute path.  An entry is used
+// if the script's size and modification time match those recorded, or if its
+// size and a 64-bit hash of its contents do.  A script with a line that does
+// not parse is run but not cached.  Set SCRIPT_NOCACHE to parse every time.
+//
+// An entry is a header (magic, script size, mtime, content hash, and a hash
+// of the rest, checked on every load) followed by the block made by packCMD() (see parse.h), which is
+//
+//   PackHeader                 magic, FORMAT_VERSION, and counts of lines,
+//                                nodes, pointers, and bytes of each part
+//   unsigned char code[nCode]  for each line, 0 if it has no command, or 1
+//                                and its tree
+//   char string[nString]       every string, each once, NUL-terminated
+//
+// A tree is a node, then its left subtree if any, then its right subtree if
+// any.  A node is its type (plus HAS_LEFT and HAS_RIGHT), fromType, toType,
+// and errType as bytes, then as LEB128 varints argc, nLocal, the string
+// offsets of argv[0..argc) and of the local names and values in pairs, and
+// those of fromFile, toFile, and errFile plus 1 (0 for NULL).  Loading needs
+// a single pass over the code that fills one allocation with the CMD
+// structures and their pointer arrays; the strings stay in the mapping.
+//
+// All integers in the headers are in host byte order; a change of layout,
+// or of what shield() makes of a line, must change FORMAT_VERSION so that
+// older entries are ignored.  Setting
+// DUMP_JSON dumps each command as JSON read from the same encoding.
+
+#include "process.h"
+
+// Run the commands in the file PATH and return the status of the last
+int run_script (const char *path);
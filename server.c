@@ -0,0 +1,366 @@
+#include "server.h"
+#include "shellstat.h"
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// largest payload accepted in a frame
+#define FRAME_MAX (64 * 1024 * 1024)
+
+
+// FUNCTION DECLARATIONS
+// run one request on connection conn; never returns
+static void serve_connection(int conn);
+// send one frame; return 0 or -1
+static int send_frame(int fd, char type, const char *data, uint32_t len);
+// receive one frame into a malloc()-ed, NUL-terminated *data; return 0 or -1
+static int recv_frame(int fd, char *type, char **data, uint32_t *len);
+// read or write exactly n bytes; return 0 or -1
+static int read_all(int fd, void *buf, size_t n);
+static int write_all(int fd, const void *buf, size_t n);
+// connect to or bind the socket path
+static int open_socket(const char *path, bool listening);
+
+
+int serve(const char *path, int nJobs) {
+    if (nJobs <= 0) {
+        nJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    int sock = open_socket(path, true);
+    if (sock < 0) {
+        return errno;
+    }
+
+    int active = 0;
+    for ( ; ; ) {
+        // reap finished workers; block while at the limit
+        int status;
+        while (active > 0 && waitpid(-1, &status, active >= nJobs ? 0 : WNOHANG) > 0) {
+            active--;
+        }
+
+        int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            int errno2 = errno;
+            perror("accept() error");
+            return errno2;
+        }
+
+        stat_add(ST_FORKS, 1);
+        int pid = fork();
+        if (pid < 0) {
+            perror("Fork failure");
+            close(conn);
+            continue;
+        }
+        if (pid == 0) {
+            close(sock);
+            serve_connection(conn);
+        }
+        close(conn);
+        active++;
+    }
+}
+
+
+static void serve_connection(int conn) {
+    // read request
+    char type;
+    char *data;
+    uint32_t len;
+    char *text = NULL;
+    uint32_t nText = 0;
+    while (text == NULL) {
+        if (recv_frame(conn, &type, &data, &len) < 0) {
+            _exit(1);
+        }
+        if (type == 'C') {
+            if (chdir(data) < 0) {
+                char msg[PATH_MAX + 64];
+                int n = snprintf(msg, sizeof(msg), "chdir() error: %s: %s\n", data, strerror(errno));
+                send_frame(conn, '2', msg, n);
+                send_frame(conn, 'S', "1", 1);
+                _exit(1);
+            }
+            free(data);
+        }
+        else if (type == 'E') {
+            putenv(data);
+        }
+        else if (type == 'X') {
+            text = data;
+            nText = len;
+        }
+        else {
+            free(data);
+        }
+    }
+
+    // the command text is the worker's stdin, so here documents work
+    int in = memfd_create("request", 0);
+    int outp[2];
+    int errp[2];
+    if (in < 0 || write_all(in, text, nText) < 0 || pipe(outp) < 0 || pipe(errp) < 0) {
+        perror("server: setup");
+        _exit(1);
+    }
+    lseek(in, 0, SEEK_SET);
+    free(text);
+
+    stat_add(ST_FORKS, 1);
+    int pid = fork();
+    if (pid < 0) {
+        perror("Fork failure");
+        _exit(1);
+    }
+    if (pid == 0) {
+        dup2(in, STDIN_FILENO);
+        dup2(outp[1], STDOUT_FILENO);
+        dup2(errp[1], STDERR_FILENO);
+        close(in);
+        close(outp[0]);
+        close(outp[1]);
+        close(errp[0]);
+        close(errp[1]);
+        close(conn);
+        setenv("?", "0", 1);
+        exit(run_lines(false));
+    }
+    close(in);
+    close(outp[1]);
+    close(errp[1]);
+
+    // relay output until both pipes reach EOF
+    struct pollfd fds[2] = {{outp[0], POLLIN, 0}, {errp[0], POLLIN, 0}};
+    int open = 2;
+    char buf[65536];
+    while (open > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || fds[i].revents == 0) {
+                continue;
+            }
+            ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+            if (n <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open--;
+            }
+            else {
+                send_frame(conn, i == 0 ? '1' : '2', buf, n);
+            }
+        }
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    char st[16];
+    int n = sprintf(st, "%d", STATUS(status));
+    send_frame(conn, 'S', st, n);
+    _exit(0);
+}
+
+
+int client(int argc, char *argv[]) {
+    int sock = open_socket(argv[0], false);
+    if (sock < 0) {
+        return errno;
+    }
+
+    // options
+    int i = 1;
+    for ( ; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-C") == 0) {
+            send_frame(sock, 'C', argv[i+1], strlen(argv[i+1]));
+        }
+        else if (strcmp(argv[i], "-e") == 0) {
+            send_frame(sock, 'E', argv[i+1], strlen(argv[i+1]));
+        }
+        else {
+            break;
+        }
+    }
+
+    // command words joined by spaces, or all of stdin
+    char *text = NULL;
+    size_t nText = 0;
+    FILE *f = open_memstream(&text, &nText);
+    if (i < argc) {
+        for (int j = i; j < argc; j++) {
+            fprintf(f, "%s%s", argv[j], j + 1 < argc ? " " : "\n");
+        }
+    }
+    else {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+            fwrite(buf, 1, n, f);
+        }
+    }
+    fclose(f);
+    if (nText > FRAME_MAX) {
+        fprintf(stderr, "client: command text over %d bytes\n", FRAME_MAX);
+        return EMSGSIZE;
+    }
+    if (send_frame(sock, 'X', text, nText) < 0) {
+        int errno2 = errno;
+        perror("client: send");
+        return errno2;
+    }
+    free(text);
+
+    // copy response
+    char type;
+    char *data;
+    uint32_t len;
+    while (recv_frame(sock, &type, &data, &len) == 0) {
+        if (type == 'S') {
+            int status = atoi(data);
+            free(data);
+            return status;
+        }
+        write_all(type == '2' ? STDERR_FILENO : STDOUT_FILENO, data, len);
+        free(data);
+    }
+    fprintf(stderr, "client: connection closed\n");
+    return 1;
+}
+
+
+static int open_socket(const char *path, bool listening) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("socket() error");
+        return -1;
+    }
+
+    if (listening) {
+        unlink(path);
+        if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sock, 128) < 0) {
+            int errno2 = errno;
+            perror(path);
+            close(sock);
+            errno = errno2;
+            return -1;
+        }
+    }
+    else if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        int errno2 = errno;
+        perror(path);
+        close(sock);
+        errno = errno2;
+        return -1;
+    }
+    return sock;
+}
+
+
+static int send_frame(int fd, char type, const char *data, uint32_t len) {
+    char header[5];
+    header[0] = type;
+    memcpy(header + 1, &len, sizeof(len));
+    struct iovec iov[2] = {{header, sizeof(header)}, {(void *) data, len}};
+    struct msghdr mh = {0};
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 2;
+
+    // sendmsg() may write only part of a large payload
+    size_t total = sizeof(header) + len;
+    ssize_t n = sendmsg(fd, &mh, MSG_NOSIGNAL);
+    if (n < 0) {
+        return -1;
+    }
+    if ((size_t) n < sizeof(header)) {
+        if (write_all(fd, header + n, sizeof(header) - n) < 0) {
+            return -1;
+        }
+        n = sizeof(header);
+    }
+    if ((size_t) n < total) {
+        size_t done = n - sizeof(header);
+        return write_all(fd, data + done, len - done);
+    }
+    return 0;
+}
+
+
+static int recv_frame(int fd, char *type, char **data, uint32_t *len) {
+    char header[5];
+    if (read_all(fd, header, sizeof(header)) < 0) {
+        return -1;
+    }
+    *type = header[0];
+    memcpy(len, header + 1, sizeof(*len));
+    // the length comes from the peer, so bound it before allocating
+    if (*len > FRAME_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    *data = malloc((size_t) *len + 1);
+    if (*data == NULL) {
+        return -1;
+    }
+    if (read_all(fd, *data, *len) < 0) {
+        free(*data);
+        return -1;
+    }
+    (*data)[*len] = '\0';
+    return 0;
+}
+
+
+static int read_all(int fd, void *buf, size_t n) {
+    char *p = buf;
+    while (n > 0) {
+        ssize_t m = read(fd, p, n);
+        if (m < 0 && errno == EINTR) {
+            continue;
+        }
+        if (m <= 0) {
+            return -1;
+        }
+        p += m;
+        n -= m;
+    }
+    return 0;
+}
+
+
+static int write_all(int fd, const void *buf, size_t n) {
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t m = send(fd, p, n, MSG_NOSIGNAL);
+        if (m < 0 && errno == ENOTSOCK) {
+            m = write(fd, p, n);
+        }
+        if (m < 0 && errno == EINTR) {
+            continue;
+        }
+        if (m < 0) {
+            return -1;
+        }
+        p += m;
+        n -= m;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+// server.h
+//
+// Server mode.  "Bash --server PATH" listens on a Unix domain socket at PATH
+// and runs each request in a forked worker through the usual tokenize(),
+// parse(), and execute path, so clients avoid the startup cost of a fresh
+// shell.  At most N requests run at once (default: number of CPUs).
+//
+// Requests and responses are sequences of frames: a one-byte type, a 32-bit
+// payload length in host order, and the payload.  A payload over 64 MB ends
+// the connection.
+//
+//   Request:   'C' DIR          Run in directory DIR (optional)
+//              'E' NAME=VALUE   Set environment variable (optional, repeats)
+//              'X' TEXT         Command text, possibly several lines with
+//                               here documents; ends the request
+//
+//   Response:  '1' DATA         Data written to stdout
+//              '2' DATA         Data written to stderr
+//              'S' STATUS       Status of the last command, in decimal;
+//                               ends the response
+//
+// "Bash --client PATH [-C DIR] [-e NAME=VALUE]... [COMMAND]..." is a small
+// client: it sends the COMMAND words (or, if none, all of stdin) and copies
+// the response to its stdout and stderr, exiting with the command's status.
+
+#include "process.h"
+
+// Serve requests on the socket PATH with at most NJOBS running at once
+// (0 = number of CPUs); returns only on error
+int serve (const char *path, int nJobs);
+
+// Client side, with ARGV[0] the socket path; return command's status
+int client (int argc, char *argv[]);
@@ -0,0 +1,179 @@
+// serverbench [SHELL [N]]
+//
+// Requests per second of server mode (see server.h) against spawning the
+// shell.  SHELL (default ./Bash) is started with --server on a socket in
+// /tmp; each command below is then sent N times (default 2000), one
+// connection per request and one request at a time, and run N times by a
+// fresh SHELL with the command on its stdin.
+#include "process.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+
+
+// FUNCTION DECLARATIONS
+// return the monotonic clock in seconds
+static double now(void);
+// send TEXT as one request to the server at PATH and read the response up
+// to its status frame; return 0 or -1
+static int request(const char *path, const char *text);
+// run a fresh SHELL with TEXT on its stdin; return 0 or -1
+static int spawn(const char *shell, const char *text);
+// read exactly n bytes; return 0 or -1
+static int read_all(int fd, void *buf, size_t n);
+
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+static int read_all(int fd, void *buf, size_t n) {
+    for (size_t done = 0; done < n; ) {
+        ssize_t r = read(fd, (char *) buf + done, n - done);
+        if (r <= 0) {
+            return -1;
+        }
+        done += r;
+    }
+    return 0;
+}
+
+
+static int request(const char *path, const char *text) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // an 'X' frame: type, 32-bit length in host order, payload
+    uint32_t len = strlen(text);
+    char head[5] = {'X'};
+    memcpy(head + 1, &len, 4);
+    if (write(fd, head, 5) != 5 || write(fd, text, len) != len) {
+        close(fd);
+        return -1;
+    }
+
+    // skip stdout and stderr frames up to the status
+    char buf[4096];
+    for ( ; ; ) {
+        if (read_all(fd, head, 5) < 0) {
+            close(fd);
+            return -1;
+        }
+        memcpy(&len, head + 1, 4);
+        for (uint32_t left = len; left > 0; ) {
+            uint32_t n = (left < sizeof(buf)) ? left : sizeof(buf);
+            if (read_all(fd, buf, n) < 0) {
+                close(fd);
+                return -1;
+            }
+            left -= n;
+        }
+        if (head[0] == 'S') {
+            close(fd);
+            return 0;
+        }
+    }
+}
+
+
+static int spawn(const char *shell, const char *text) {
+    int fd[2];
+    if (pipe(fd) < 0) {
+        return -1;
+    }
+    int pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        // the shell's prompts and the command's output are discarded
+        int null = open("/dev/null", O_WRONLY);
+        dup2(fd[0], STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        close(null);
+        execl(shell, shell, (char *) NULL);
+        _exit(127);
+    }
+    close(fd[0]);
+    ssize_t w = write(fd[1], text, strlen(text));
+    close(fd[1]);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return (w < 0 || !WIFEXITED(status) || WEXITSTATUS(status) == 127) ? -1 : 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *shell = (argc > 1) ? argv[1] : "./Bash";
+    int n = (argc > 2) ? atoi(argv[2]) : 2000;
+    const char *commands[] = {"echo hi\n", "true\n", "/bin/true\n"};
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/serverbench.%d", getpid());
+    int server = fork();
+    if (server < 0) {
+        perror("Fork failure");
+        return 1;
+    }
+    if (server == 0) {
+        execl(shell, shell, "--server", path, (char *) NULL);
+        perror(shell);
+        _exit(127);
+    }
+
+    // wait up to 5 seconds for the socket to accept connections
+    int ready = -1;
+    for (int i = 0; i < 500 && ready < 0; i++) {
+        ready = request(path, "\n");
+        if (ready < 0) {
+            usleep(10000);
+        }
+    }
+    if (ready < 0) {
+        fprintf(stderr, "serverbench: %s --server did not start\n", shell);
+        kill(server, SIGTERM);
+        return 1;
+    }
+
+    int ret_val = 0;
+    printf("%d requests each, one at a time\n", n);
+    for (unsigned c = 0; c < sizeof(commands) / sizeof(commands[0]) && ret_val == 0; c++) {
+        double start = now();
+        for (int i = 0; i < n && ret_val == 0; i++) {
+            ret_val = request(path, commands[c]);
+        }
+        double served = n / (now() - start);
+
+        start = now();
+        for (int i = 0; i < n && ret_val == 0; i++) {
+            ret_val = spawn(shell, commands[c]);
+        }
+        double spawned = n / (now() - start);
+
+        printf("  %-12.*s server %7.0f req/s   spawn %7.0f req/s   (%.2fx)\n",
+               (int) strlen(commands[c]) - 1, commands[c], served, spawned, served / spawned);
+    }
+    if (ret_val < 0) {
+        fprintf(stderr, "serverbench: request failed\n");
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(path);
+    return ret_val < 0;
+}
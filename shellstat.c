@@ -0,0 +1,255 @@
+#include "shellstat.h"
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// histogram buckets per command (the last holds everything over ~35 min)
+#define STAT_BUCKETS 32
+
+// command names tracked; further names are counted under "(other)"
+#define STAT_NAMES 256
+
+// longest command name kept (longer ones are truncated)
+#define STAT_NAMELEN 31
+
+
+// one command name
+typedef struct statName {
+    _Atomic int state;                  // 0 free, 1 being claimed, 2 in use
+    char name[STAT_NAMELEN + 1];
+    _Atomic long count;                 // commands run
+    _Atomic long total_ns;              // their total wall time
+    _Atomic long bucket[STAT_BUCKETS];  // their wall times
+} StatName;
+
+// everything shared between the shell and its children
+typedef struct stats {
+    _Atomic long counter[ST_COUNTERS];
+    StatName names[STAT_NAMES];
+    StatName other;
+} Stats;
+
+static Stats *stats = NULL;
+static int shell_pid = 0;          // process that dumps at exit
+
+static const char *counter_names[ST_COUNTERS] = {
+    "lines", "parse_ns", "forks", "execs", "exec_failures", "pipes",
+    "redirections", "heredocs", "bg_launched", "bg_reaped", "builtins",
+    "cache_hits", "cache_misses", "cache_evictions"
+};
+
+
+// FUNCTION DECLARATIONS
+// return the entry for name, claiming a free one if needed
+static StatName *find_name(const char *name);
+// write the statistics to f as text
+static void write_text(FILE *f);
+// write the statistics to f as JSON
+static void write_json(FILE *f);
+// write s to f as a JSON string
+static void json_string(FILE *f, const char *s);
+// write the entry e as part of a JSON object
+static void json_name(FILE *f, const StatName *e, bool first);
+// atexit() handler for SHELLSTAT_DUMP
+static void dump_at_exit(void);
+
+
+void stat_init(void) {
+    stats = mmap(NULL, sizeof(Stats), PROT_READ|PROT_WRITE,
+                 MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        stats = NULL;
+        return;
+    }
+    strcpy(stats->other.name, "(other)");
+    shell_pid = getpid();
+    atexit(dump_at_exit);
+}
+
+
+void stat_add(int c, long n) {
+    if (stats != NULL) {
+        atomic_fetch_add_explicit(&stats->counter[c], n, memory_order_relaxed);
+    }
+}
+
+
+long stat_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+static StatName *find_name(const char *name) {
+    // open addressing on a hash of the (truncated) name
+    char key[STAT_NAMELEN + 1];
+    strncpy(key, name, STAT_NAMELEN);
+    key[STAT_NAMELEN] = '\0';
+    unsigned h = 5381;
+    for (const char *s = key; *s; s++) {
+        h = h * 33 + (unsigned char) *s;
+    }
+
+    for (int probe = 0; probe < STAT_NAMES; probe++) {
+        StatName *e = &stats->names[(h + probe) % STAT_NAMES];
+        int state = atomic_load(&e->state);
+        if (state == 0) {
+            int expected = 0;
+            if (atomic_compare_exchange_strong(&e->state, &expected, 1)) {
+                strcpy(e->name, key);
+                atomic_store(&e->state, 2);
+                return e;
+            }
+            state = expected;
+        }
+        // another process is filling in this entry
+        while (state == 1) {
+            state = atomic_load(&e->state);
+        }
+        if (strcmp(e->name, key) == 0) {
+            return e;
+        }
+    }
+    return &stats->other;
+}
+
+
+void stat_command(const char *name, long ns) {
+    if (stats == NULL) {
+        return;
+    }
+    StatName *e = find_name(name);
+    long us = ns / 1000;
+    int b = 0;
+    while (us > 1 && b < STAT_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    atomic_fetch_add_explicit(&e->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->total_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->bucket[b], 1, memory_order_relaxed);
+}
+
+
+static void write_text(FILE *f) {
+    for (int c = 0; c < ST_COUNTERS; c++) {
+        fprintf(f, "%-16s%ld\n", counter_names[c], atomic_load(&stats->counter[c]));
+    }
+    for (int i = 0; i <= STAT_NAMES; i++) {
+        const StatName *e = (i < STAT_NAMES) ? &stats->names[i] : &stats->other;
+        long count = atomic_load(&e->count);
+        if (count == 0) {
+            continue;
+        }
+        fprintf(f, "%-16s%ld runs, %.3f ms total;", e->name, count,
+                atomic_load(&e->total_ns) / 1e6);
+        for (int b = 0; b < STAT_BUCKETS; b++) {
+            long n = atomic_load(&e->bucket[b]);
+            if (n > 0) {
+                fprintf(f, " %ldus:%ld", b ? 1L << b : 0L, n);
+            }
+        }
+        putc('\n', f);
+    }
+}
+
+
+static void json_string(FILE *f, const char *s) {
+    putc('"', f);
+    for ( ; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        }
+        else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        }
+        else {
+            putc(c, f);
+        }
+    }
+    putc('"', f);
+}
+
+
+static void json_name(FILE *f, const StatName *e, bool first) {
+    if (!first) {
+        putc(',', f);
+    }
+    json_string(f, e->name);
+    fprintf(f, ":{\"count\":%ld,\"total_ns\":%ld,\"buckets_us\":{",
+            atomic_load(&e->count), atomic_load(&e->total_ns));
+    bool firstBucket = true;
+    for (int b = 0; b < STAT_BUCKETS; b++) {
+        long n = atomic_load(&e->bucket[b]);
+        if (n > 0) {
+            fprintf(f, "%s\"%ld\":%ld", firstBucket ? "" : ",", b ? 1L << b : 0L, n);
+            firstBucket = false;
+        }
+    }
+    fputs("}}", f);
+}
+
+
+static void write_json(FILE *f) {
+    putc('{', f);
+    for (int c = 0; c < ST_COUNTERS; c++) {
+        fprintf(f, "\"%s\":%ld,", counter_names[c], atomic_load(&stats->counter[c]));
+    }
+    fputs("\"commands\":{", f);
+    bool first = true;
+    for (int i = 0; i <= STAT_NAMES; i++) {
+        const StatName *e = (i < STAT_NAMES) ? &stats->names[i] : &stats->other;
+        if (atomic_load(&e->count) > 0) {
+            json_name(f, e, first);
+            first = false;
+        }
+    }
+    fputs("}}\n", f);
+}
+
+
+int shellstat_command(const CMD *cmdList) {
+    bool json = false;
+    for (int i = 1; i < cmdList->argc; i++) {
+        if (strcmp(cmdList->argv[i], "-j") == 0) {
+            json = true;
+        }
+        else {
+            fprintf(stderr, "usage: shellstat [-j]\n");
+            return 2;
+        }
+    }
+    if (stats == NULL) {
+        fprintf(stderr, "shellstat: no statistics\n");
+        return 1;
+    }
+
+    if (json) {
+        write_json(stdout);
+    }
+    else {
+        write_text(stdout);
+    }
+    if (fflush(stdout) == EOF) {
+        int errno2 = errno;
+        perror("shellstat");
+        return errno2;
+    }
+    return 0;
+}
+
+
+static void dump_at_exit(void) {
+    const char *dump = getenv("SHELLSTAT_DUMP");
+    if (dump == NULL || getpid() != shell_pid) {
+        return;
+    }
+    if (strcmp(dump, "json") == 0) {
+        write_json(stderr);
+    }
+    else {
+        write_text(stderr);
+    }
+}
@@ -0,0 +1,50 @@
+// shellstat.h
+//
+// Runtime statistics.  The shell keeps cumulative counters of its own work
+// and, for each command name (argv[0]), a histogram of the wall time of the
+// simple commands and built-ins run under that name.  Bucket B counts times
+// in [2^B, 2^(B+1)) microseconds (bucket 0 also counts shorter ones).
+//
+// The counters live in a shared anonymous mapping made before anything is
+// forked, so work done by the shell's children (pipeline stages, subshells,
+// the zygote) is counted too.  Each update is a relaxed atomic add.
+//
+// Built-in "shellstat [-j]" writes the statistics to stdout as text, or as
+// one JSON object with -j.  If SHELLSTAT_DUMP is set, the shell writes them
+// to stderr when it exits (as JSON if its value is "json").
+
+#include "process.h"
+
+// counters
+enum {
+    ST_LINES,           // command lines read
+    ST_PARSE_NS,        // time spent shielding, lexing, and parsing lines
+    ST_FORKS,           // processes forked
+    ST_EXECS,           // execvp() calls
+    ST_EXEC_FAILS,      // execvp() calls that failed
+    ST_PIPES,           // pipes created
+    ST_REDIRS,          // files opened for redirections
+    ST_HEREDOCS,        // here documents written to files
+    ST_BG_LAUNCHED,     // background jobs started
+    ST_BG_REAPED,       // background processes reaped
+    ST_BUILTINS,        // built-ins run
+    ST_CACHE_HITS,      // cached commands replayed (see cached.h)
+    ST_CACHE_MISSES,    // cached commands run
+    ST_CACHE_EVICTIONS, // cache entries evicted
+    ST_COUNTERS
+};
+
+// Map the shared counters and arrange for SHELLSTAT_DUMP; call once, first
+void stat_init (void);
+
+// Add N to counter C
+void stat_add (int c, long n);
+
+// Return the time in nanoseconds since an arbitrary point
+long stat_now (void);
+
+// Record that a command named NAME took NS nanoseconds
+void stat_command (const char *name, long ns);
+
+// Built-in shellstat; return status
+int shellstat_command (const CMD *cmdList);
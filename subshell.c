@@ -0,0 +1,109 @@
+#include "subshell.h"
+#include <fcntl.h>
+
+extern char **environ;
+
+
+// FUNCTION DECLARATIONS
+// return true if argv0 is a built-in that is safe to run in the shell
+static bool inline_builtin(const char *argv0);
+// return the value of name=value in env with name n bytes long, or NULL
+static const char *env_find(char **env, const char *name, size_t n);
+
+
+static bool inline_builtin(const char *argv0) {
+    static const char *safe[] = {"cd", "pushd", "popd", "echo", "pwd", ":", "read"};
+    for (int i = 0; i < sizeof(safe) / sizeof(safe[0]); i++) {
+        if (strcmp(argv0, safe[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool subshell_inline(const CMD *cmdList) {
+    if (cmdList == NULL) {
+        return true;
+    }
+    switch (cmdList->type) {
+        case SIMPLE:
+            return inline_builtin(cmdList->argv[0]);
+        case SUBCMD:
+            return subshell_inline(cmdList->left);
+        case SEP_END:
+        case SEP_AND:
+        case SEP_OR:
+            return subshell_inline(cmdList->left) && subshell_inline(cmdList->right);
+        default:
+            return false;
+    }
+}
+
+
+void subshell_save(Snapshot *snap) {
+    snap->cwd = open(".", O_PATH|O_DIRECTORY|O_CLOEXEC);
+
+    int n = 0;
+    while (environ[n]) {
+        n++;
+    }
+    snap->env = malloc((n + 1) * sizeof(char *));
+    for (int i = 0; i < n; i++) {
+        snap->env[i] = strdup(environ[i]);
+    }
+    snap->env[n] = NULL;
+
+    snap->dirs = dirs_save();
+}
+
+
+static const char *env_find(char **env, const char *name, size_t n) {
+    for (int i = 0; env[i]; i++) {
+        if (strncmp(env[i], name, n) == 0 && env[i][n] == '=') {
+            return env[i] + n + 1;
+        }
+    }
+    return NULL;
+}
+
+
+void subshell_restore(Snapshot *snap) {
+    if (snap->cwd >= 0) {
+        if (fchdir(snap->cwd) < 0) {
+            perror("fchdir() error");
+        }
+        close(snap->cwd);
+    }
+
+    // unset variables the body added (unsetenv() shifts environ down)
+    for (int i = 0; environ[i]; ) {
+        char *eq = strchr(environ[i], '=');
+        size_t n = eq ? eq - environ[i] : strlen(environ[i]);
+        if (env_find(snap->env, environ[i], n) == NULL) {
+            char *name = strndup(environ[i], n);
+            unsetenv(name);
+            free(name);
+            continue;
+        }
+        i++;
+    }
+
+    // put back values the body changed or removed
+    for (int i = 0; snap->env[i]; i++) {
+        char *eq = strchr(snap->env[i], '=');
+        if (eq == NULL) {
+            free(snap->env[i]);
+            continue;
+        }
+        *eq = '\0';
+        const char *now = getenv(snap->env[i]);
+        if (now == NULL || strcmp(now, eq + 1) != 0) {
+            setenv(snap->env[i], eq + 1, 1);
+        }
+        free(snap->env[i]);
+    }
+    free(snap->env);
+
+    dirs_restore(snap->dirs);
+}
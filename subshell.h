@@ -0,0 +1,32 @@
+// subshell.h
+//
+// Subshells that run in the shell itself.  A subshell ( ... ) whose body is
+// made only of the built-ins cd, pushd, popd, echo, pwd, :, and read (joined
+// by ;, &&, ||, or nested ( ... )) does not fork.  Instead the state that the
+// body could change is saved first and put back afterwards:
+//
+//   - the working directory, as an O_PATH descriptor
+//   - the environment (variables)
+//   - the pushd/popd directory stack
+//   - the descriptors replaced by the subshell's redirections (see
+//     built_in_command() in process.c)
+//
+// A body with any other command (or a pipeline or & list) forks as before.
+
+#include "process.h"
+
+// state of the shell saved by subshell_save()
+typedef struct snapshot {
+    int cwd;            // O_PATH descriptor of the working directory
+    char **env;         // copy of environ, NULL-terminated
+    void *dirs;         // copy of the directory stack (see dirs_save())
+} Snapshot;
+
+// Return true if CMDLIST can run in the shell without a fork
+bool subshell_inline (const CMD *cmdList);
+
+// Save the state of the shell in *SNAP
+void subshell_save (Snapshot *snap);
+
+// Put back the state saved in *SNAP and free it
+void subshell_restore (Snapshot *snap);
@@ -0,0 +1,209 @@
+#include "tee.h"
+#include "shellstat.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// size of user-space buffer for the copying fallback
+#define TEE_BUFSIZE (128 * 1024)
+
+
+// FUNCTION DECLARATIONS
+// zero-copy loop for a pipe on stdin; returns 0, or -1 to fall back to copying
+static int tee_splice(int *outs, int nOut);
+// buffered loop for any stdin
+static int tee_copy(int *outs, int nOut);
+// move exactly n bytes from pipe in to out; return 0 or -1
+static int move_all(int in, int out, size_t n);
+// write all n bytes of buf to fd; return 0 or -1
+static int write_all(int fd, const char *buf, size_t n);
+
+// parse.o exports its own splice(), so call the system call directly
+static ssize_t sys_splice(int in, int out, size_t n) {
+    return syscall(SYS_splice, in, NULL, out, NULL, n, SPLICE_F_MOVE);
+}
+
+
+int tee_command(const CMD *cmdList) {
+    int ret_val = 0;
+    int flags = O_WRONLY|O_CREAT|O_TRUNC;
+
+    // options
+    int i = 1;
+    for ( ; i < cmdList->argc && cmdList->argv[i][0] == '-' && cmdList->argv[i][1]; i++) {
+        if (strcmp(cmdList->argv[i], "-a") == 0) {
+            flags = O_WRONLY|O_CREAT|O_APPEND;
+        }
+        else if (strcmp(cmdList->argv[i], "-i") == 0) {
+            signal(SIGINT, SIG_IGN);
+        }
+        else {
+            fprintf(stderr, "tee: invalid option %s\n", cmdList->argv[i]);
+            return 1;
+        }
+    }
+
+    // stdout first, then each file that could be opened
+    int *outs = malloc((cmdList->argc - i + 1) * sizeof(int));
+    int nOut = 0;
+    outs[nOut++] = STDOUT_FILENO;
+    for ( ; i < cmdList->argc; i++) {
+        int fd = open(cmdList->argv[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", cmdList->argv[i], strerror(errno));
+            ret_val = 1;
+            continue;
+        }
+        outs[nOut++] = fd;
+    }
+
+    struct stat st;
+    int r = -1;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        r = tee_splice(outs, nOut);
+    }
+    if (r < 0) {
+        r = tee_copy(outs, nOut);
+    }
+    if (r != 0) {
+        ret_val = 1;
+    }
+
+    for (int j = 1; j < nOut; j++) {
+        close(outs[j]);
+    }
+    free(outs);
+    return ret_val;
+}
+
+
+static int tee_splice(int *outs, int nOut) {
+    // one output: just move the pages along
+    if (nOut == 1) {
+        for ( ; ; ) {
+            ssize_t n = sys_splice(STDIN_FILENO, outs[0], 1 << 20);
+            if (n == 0) {
+                return 0;
+            }
+            if (n < 0) {
+                // nothing consumed yet if the output cannot splice
+                return (errno == EINVAL) ? -1 : 1;
+            }
+        }
+    }
+
+    // otherwise duplicate each chunk into an empty scratch pipe once per
+    // extra output and drain it there; the last output consumes the input
+    int scratch[2];
+    if (pipe(scratch) < 0) {
+        return -1;
+    }
+    stat_add(ST_PIPES, 1);
+    int cap = fcntl(STDIN_FILENO, F_GETPIPE_SZ);
+    if (cap > 0) {
+        fcntl(scratch[0], F_SETPIPE_SZ, cap);
+    }
+    cap = fcntl(scratch[0], F_GETPIPE_SZ);
+    if (cap <= 0) {
+        cap = 65536;
+    }
+
+    int ret_val = 0;
+    for ( ; ; ) {
+        // snapshot what is in the input pipe (blocks until data or EOF)
+        ssize_t n = tee(STDIN_FILENO, scratch[1], cap, 0);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            ret_val = 1;
+            break;
+        }
+
+        for (int i = 0; i < nOut - 1; i++) {
+            if (i > 0 && tee(STDIN_FILENO, scratch[1], n, 0) != n) {
+                ret_val = 1;
+                break;
+            }
+            if (move_all(scratch[0], outs[i], n) < 0) {
+                ret_val = 1;
+                break;
+            }
+        }
+        if (ret_val != 0 || move_all(STDIN_FILENO, outs[nOut - 1], n) < 0) {
+            ret_val = 1;
+            break;
+        }
+    }
+
+    close(scratch[0]);
+    close(scratch[1]);
+    return ret_val;
+}
+
+
+static int move_all(int in, int out, size_t n) {
+    while (n > 0) {
+        ssize_t m = sys_splice(in, out, n);
+        if (m < 0 && errno == EINVAL) {
+            // out cannot splice (e.g. O_APPEND file); copy the rest
+            char buf[65536];
+            m = read(in, buf, n < sizeof(buf) ? n : sizeof(buf));
+            if (m > 0 && write_all(out, buf, m) < 0) {
+                return -1;
+            }
+        }
+        if (m <= 0) {
+            return -1;
+        }
+        n -= m;
+    }
+    return 0;
+}
+
+
+static int tee_copy(int *outs, int nOut) {
+    char *buf = malloc(TEE_BUFSIZE);
+    int ret_val = 0;
+
+    for ( ; ; ) {
+        ssize_t n = read(STDIN_FILENO, buf, TEE_BUFSIZE);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("tee: read");
+            ret_val = 1;
+            break;
+        }
+        for (int i = 0; i < nOut; i++) {
+            if (outs[i] >= 0 && write_all(outs[i], buf, n) < 0) {
+                perror("tee: write");
+                outs[i] = -1;
+                ret_val = 1;
+            }
+        }
+    }
+
+    free(buf);
+    return ret_val;
+}
+
+
+static int write_all(int fd, const char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t m = write(fd, buf, n);
+        if (m < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += m;
+        n -= m;
+    }
+    return 0;
+}
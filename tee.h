@@ -0,0 +1,12 @@
+// tee.h
+//
+// Built-in "tee [-a] [-i] [FILE]..." for pipeline stages.  Copies stdin to
+// stdout and to each FILE.  When stdin is a pipe the data is duplicated in
+// the kernel with tee(2) and moved with splice(2), so no byte is copied
+// through user space; otherwise it falls back to buffered read/write.
+
+#include "process.h"
+
+// Run the tee built-in described by CMDLIST (whose redirections have already
+// been applied) and return its status
+int tee_command (const CMD *cmdList);
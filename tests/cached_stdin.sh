@@ -0,0 +1,9 @@
+rm -rf /tmp/bsh-test-cached
+echo b | CACHED_DIR=/tmp/bsh-test-cached cached sort
+echo a | CACHED_DIR=/tmp/bsh-test-cached cached sort
+echo b | CACHED_DIR=/tmp/bsh-test-cached cached sort
+printf 'c\na\n' | CACHED_DIR=/tmp/bsh-test-cached cached sort
+printf 'c\na\n' | CACHED_DIR=/tmp/bsh-test-cached cached sort
+CACHED_DIR=/tmp/bsh-test-cached cached sort < /dev/null
+CACHED_DIR=/tmp/bsh-test-cached cached -s | sed 's/ [0-9]* bytes//'
+rm -rf /tmp/bsh-test-cached
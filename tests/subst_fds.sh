@@ -0,0 +1,5 @@
+exec 3>&-
+echo [$(echo leak >&3)]
+echo [$(echo kept)] [$(: ; echo two)]
+exec 3>&1
+echo [$(echo via3 >&3)]
@@ -0,0 +1,2 @@
+taskset 0 /bin/echo '*.h' "*.c" \*.o
+taskset -c 0 /bin/echo *.nomatch
@@ -0,0 +1,573 @@
+#include "threadpipe.h"
+#include "shellstat.h"
+#include "expand.h"
+#include "jobs.h"
+#include "pipeprof.h"
+#include "affinity.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// bytes held by a ring (the default capacity of a pipe)
+#define RING_SIZE (64 * 1024)
+
+// times a ring is polled before the thread sleeps on its futex
+#define RING_SPINS 200
+
+
+// buffer between two adjacent stages; head is written only by the
+// producer and tail only by the consumer
+typedef struct ring {
+    _Atomic size_t head;        // bytes written
+    _Atomic size_t tail;        // bytes read
+    _Atomic bool closed_w;      // producer finished
+    _Atomic bool closed_r;      // consumer finished
+    _Atomic unsigned seq;       // futex word, bumped after every change
+    _Atomic int sleepers;       // threads waiting on seq
+    char buf[RING_SIZE];
+} Ring;
+
+// input or output of a stage: a ring, or if ring is NULL a descriptor
+typedef struct stream {
+    Ring *ring;
+    int fd;
+} Stream;
+
+// one stage running as a thread
+typedef struct stage {
+    const CMD *cmd;
+    Stream in, out;
+    int status;
+    pthread_t thread;
+} Stage;
+
+
+// FUNCTION DECLARATIONS
+// return true if cmd can run as a thread
+static bool thread_stage(const CMD *cmd);
+// return true if stage cmd reads its stdin
+static bool reads_input(const CMD *cmd);
+// return true if cmd is tee -i
+static bool ignores_interrupt(const CMD *cmd);
+// wake threads waiting for a change in r
+static void ring_wake(Ring *r);
+// sleep until r changes, unless it has since seen was read
+static void ring_wait(Ring *r, unsigned seen);
+// read up to n bytes from r into buf; return the number read, 0 at EOF
+static size_t ring_read(Ring *r, char *buf, size_t n);
+// write n bytes of buf to r; return 0, or -1 if the consumer has finished
+static int ring_write(Ring *r, const char *buf, size_t n);
+// read up to n bytes from s; return the number read, 0 at EOF, -1 on error
+static ssize_t stream_read(Stream *s, char *buf, size_t n);
+// write n bytes of buf to s; return 0 or the status for the stage
+static int stream_write(Stream *s, const char *buf, size_t n);
+// thread body: run the stage and close its rings
+static void *run_stage(void *arg);
+// the built-ins; each returns its status
+static int echo_stage(Stage *s);
+static int pwd_stage(Stage *s);
+static int cat_stage(Stage *s);
+static int tee_stage(Stage *s);
+// copy in to out (and to files[0..nFile)); return status
+static int copy_stream(Stage *s, int *files, int nFile);
+// run all stages of cmdList in the calling process; return status
+static int thread_pipeline(const CMD *cmdList);
+
+
+static bool thread_stage(const CMD *cmd) {
+    if (cmd->type != SIMPLE || cmd->nLocal > 0 || cmd->fromType != NONE
+            || cmd->toType != NONE || hasFdRedirs(cmd)) {
+        return false;
+    }
+    const char *name = cmd->argv[0];
+    if (strcmp(name, "echo") == 0 || strcmp(name, "pwd") == 0 || strcmp(name, ":") == 0) {
+        return true;
+    }
+    if (strcmp(name, "tee") == 0) {
+        for (int i = 1; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1]; i++) {
+            if (strcmp(cmd->argv[i], "-a") != 0 && strcmp(cmd->argv[i], "-i") != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (strcmp(name, "cat") == 0) {
+        // no options
+        for (int i = 1; i < cmd->argc; i++) {
+            if (cmd->argv[i][0] == '-' && cmd->argv[i][1]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+
+static bool reads_input(const CMD *cmd) {
+    if (strcmp(cmd->argv[0], "tee") == 0) {
+        return true;
+    }
+    if (strcmp(cmd->argv[0], "cat") == 0) {
+        for (int i = 1; i < cmd->argc; i++) {
+            if (strcmp(cmd->argv[i], "-") == 0) {
+                return true;
+            }
+        }
+        return cmd->argc == 1;
+    }
+    return false;
+}
+
+
+static bool ignores_interrupt(const CMD *cmd) {
+    if (strcmp(cmd->argv[0], "tee") != 0) {
+        return false;
+    }
+    // options as tee_stage() reads them: any but -a is -i
+    for (int i = 1; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1]; i++) {
+        if (strcmp(cmd->argv[i], "-a") != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int thread_suffix(const CMD *cmdList) {
+    if (getenv("PIPE_NOTHREADS") != NULL || pipeprof_enabled()) {
+        return 0;
+    }
+    int k = 0;
+    while (cmdList->type == PIPE && thread_stage(cmdList->right)) {
+        k++;
+        cmdList = cmdList->left;
+    }
+    if (cmdList->type != PIPE && thread_stage(cmdList)) {
+        k++;
+    }
+    return (k >= 2) ? k : 0;
+}
+
+
+CMD *thread_regroup(const CMD *cmdList, int k) {
+    // nodes[0] joins the prefix to the group; nodes[1..k-1] form the group
+    CMD *nodes = calloc(k, sizeof(CMD));
+    const CMD **stages = malloc(k * sizeof(CMD *));
+    for (int j = k - 1; j >= 0; j--) {
+        stages[j] = cmdList->right;
+        cmdList = cmdList->left;
+    }
+
+    const CMD *left = stages[0];
+    for (int j = 1; j < k; j++) {
+        nodes[j].type = PIPE;
+        nodes[j].left = (CMD *) left;
+        nodes[j].right = (CMD *) stages[j];
+        left = &nodes[j];
+    }
+    nodes[0].type = PIPE;
+    nodes[0].left = (CMD *) cmdList;
+    nodes[0].right = (CMD *) left;
+    for (int j = 0; j < k; j++) {
+        nodes[j].fromType = nodes[j].toType = nodes[j].errType = NONE;
+    }
+    free(stages);
+    return nodes;
+}
+
+
+int thread_command(const CMD *cmdList) {
+    const CMD *first = cmdList;
+    while (first->type == PIPE) {
+        first = first->left;
+    }
+
+    // a shell that cannot be interrupted must not wait on its own stdin,
+    // and under job control the group must be a job that ^Z can stop
+    if (!job_shell() || (!job_control() && !reads_input(first))) {
+        return thread_pipeline(cmdList);
+    }
+
+    int pid = job_fork(true);
+    if (pid < 0) {
+        int errno2 = errno;
+        perror("Fork failure");
+        job_done();
+        return errno2;
+    }
+    if (pid == 0) {
+        exit(thread_pipeline(cmdList));
+    }
+    int status;
+    job_wait(pid, &status, NULL, cmdList);
+    job_done();
+    return STATUS(status);
+}
+
+
+static void ring_wake(Ring *r) {
+    atomic_fetch_add(&r->seq, 1);
+    if (atomic_load(&r->sleepers) > 0) {
+        syscall(SYS_futex, &r->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+
+static void ring_wait(Ring *r, unsigned seen) {
+    atomic_fetch_add(&r->sleepers, 1);
+    syscall(SYS_futex, &r->seq, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+    atomic_fetch_sub(&r->sleepers, 1);
+}
+
+
+static size_t ring_read(Ring *r, char *buf, size_t n) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    for (int spins = 0; ; spins++) {
+        unsigned seen = atomic_load(&r->seq);
+        bool closed = atomic_load(&r->closed_w);
+        size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (head != tail) {
+            // copy up to the end of buf, then from its start
+            size_t m = head - tail < n ? head - tail : n;
+            size_t at = tail % RING_SIZE;
+            size_t first = m < RING_SIZE - at ? m : RING_SIZE - at;
+            memcpy(buf, r->buf + at, first);
+            memcpy(buf + first, r->buf, m - first);
+            atomic_store_explicit(&r->tail, tail + m, memory_order_release);
+            ring_wake(r);
+            return m;
+        }
+        if (closed) {
+            return 0;
+        }
+        if (spins >= RING_SPINS) {
+            ring_wait(r, seen);
+        }
+    }
+}
+
+
+static int ring_write(Ring *r, const char *buf, size_t n) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    for (int spins = 0; n > 0; spins++) {
+        unsigned seen = atomic_load(&r->seq);
+        size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        size_t space = RING_SIZE - (head - tail);
+        if (space > 0) {
+            size_t m = n < space ? n : space;
+            size_t at = head % RING_SIZE;
+            size_t first = m < RING_SIZE - at ? m : RING_SIZE - at;
+            memcpy(r->buf + at, buf, first);
+            memcpy(r->buf, buf + first, m - first);
+            head += m;
+            atomic_store_explicit(&r->head, head, memory_order_release);
+            ring_wake(r);
+            buf += m;
+            n -= m;
+            spins = 0;
+            continue;
+        }
+        // full: like a pipe, fail only when no reader is left to drain it
+        if (atomic_load(&r->closed_r)) {
+            return -1;
+        }
+        if (spins >= RING_SPINS) {
+            ring_wait(r, seen);
+        }
+    }
+    return 0;
+}
+
+
+static ssize_t stream_read(Stream *s, char *buf, size_t n) {
+    if (s->ring != NULL) {
+        return ring_read(s->ring, buf, n);
+    }
+    ssize_t r;
+    while ((r = read(s->fd, buf, n)) < 0 && errno == EINTR)
+        ;
+    return r;
+}
+
+
+static int stream_write(Stream *s, const char *buf, size_t n) {
+    if (s->ring != NULL) {
+        return (ring_write(s->ring, buf, n) < 0) ? 128 + SIGPIPE : 0;
+    }
+    while (n > 0) {
+        ssize_t w = write(s->fd, buf, n);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int errno2 = errno;
+            perror("write() error");
+            return errno2;
+        }
+        buf += w;
+        n -= w;
+    }
+    return 0;
+}
+
+
+static void *run_stage(void *arg) {
+    Stage *s = arg;
+    const char *name = s->cmd->argv[0];
+    long start = stat_now();
+    if (strcmp(name, "echo") == 0) {
+        s->status = echo_stage(s);
+    }
+    else if (strcmp(name, "pwd") == 0) {
+        s->status = pwd_stage(s);
+    }
+    else if (strcmp(name, "cat") == 0) {
+        s->status = cat_stage(s);
+    }
+    else if (strcmp(name, "tee") == 0) {
+        s->status = tee_stage(s);
+    }
+    else {
+        s->status = 0;
+    }
+    stat_command(name, stat_now() - start);
+    stat_add(ST_BUILTINS, 1);
+
+    // EOF for the consumer; EPIPE for the producer
+    if (s->out.ring != NULL) {
+        atomic_store(&s->out.ring->closed_w, true);
+        ring_wake(s->out.ring);
+    }
+    if (s->in.ring != NULL) {
+        atomic_store(&s->in.ring->closed_r, true);
+        ring_wake(s->in.ring);
+    }
+    return NULL;
+}
+
+
+static int echo_stage(Stage *s) {
+    const CMD *cmd = s->cmd;
+    int i = 1;
+    bool newline = true;
+    if (cmd->argc > 1 && strcmp(cmd->argv[1], "-n") == 0) {
+        newline = false;
+        i++;
+    }
+
+    char *line;
+    size_t size;
+    FILE *f = open_memstream(&line, &size);
+    for (int first = i; i < cmd->argc; i++) {
+        if (i > first) {
+            putc(' ', f);
+        }
+        fputs(cmd->argv[i], f);
+    }
+    if (newline) {
+        putc('\n', f);
+    }
+    fclose(f);
+    int ret_val = stream_write(&s->out, line, size);
+    free(line);
+    return ret_val;
+}
+
+
+static int pwd_stage(Stage *s) {
+    char *current_directory = get_current_dir_name();
+    if (current_directory == NULL) {
+        int errno2 = errno;
+        perror("getcwd() error");
+        return errno2;
+    }
+    size_t n = strlen(current_directory);
+    current_directory[n] = '\n';
+    int ret_val = stream_write(&s->out, current_directory, n + 1);
+    free(current_directory);
+    return ret_val;
+}
+
+
+static int copy_stream(Stage *s, int *files, int nFile) {
+    char *buf = malloc(RING_SIZE);
+    int ret_val = 0;
+    ssize_t n;
+    while ((n = stream_read(&s->in, buf, RING_SIZE)) > 0) {
+        for (int j = 0; j < nFile; j++) {
+            Stream file = {NULL, files[j]};
+            if (files[j] >= 0 && stream_write(&file, buf, n) != 0) {
+                files[j] = -1;
+                ret_val = 1;
+            }
+        }
+        int w = stream_write(&s->out, buf, n);
+        if (w != 0) {
+            ret_val = w;
+            break;
+        }
+    }
+    if (n < 0) {
+        perror("read() error");
+        ret_val = 1;
+    }
+    free(buf);
+    return ret_val;
+}
+
+
+static int cat_stage(Stage *s) {
+    const CMD *cmd = s->cmd;
+    if (cmd->argc == 1) {
+        return copy_stream(s, NULL, 0);
+    }
+
+    int ret_val = 0;
+    Stream in = s->in;
+    for (int i = 1; i < cmd->argc; i++) {
+        if (strcmp(cmd->argv[i], "-") == 0) {
+            s->in = in;
+        }
+        else {
+            int fd = open(cmd->argv[i], O_RDONLY);
+            if (fd < 0) {
+                fprintf(stderr, "cat: %s: %s\n", cmd->argv[i], strerror(errno));
+                ret_val = 1;
+                continue;
+            }
+            s->in = (Stream) {NULL, fd};
+        }
+        int r = copy_stream(s, NULL, 0);
+        if (s->in.ring == NULL && s->in.fd != in.fd) {
+            close(s->in.fd);
+        }
+        if (r == 128 + SIGPIPE) {
+            ret_val = r;
+            break;
+        }
+        if (r != 0) {
+            ret_val = 1;
+        }
+    }
+    s->in = in;
+    return ret_val;
+}
+
+
+static int tee_stage(Stage *s) {
+    const CMD *cmd = s->cmd;
+    int flags = O_WRONLY|O_CREAT|O_TRUNC;
+    int i = 1;
+    for ( ; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1]; i++) {
+        // -i is handled by thread_pipeline() for the whole process
+        if (strcmp(cmd->argv[i], "-a") == 0) {
+            flags = O_WRONLY|O_CREAT|O_APPEND;
+        }
+    }
+
+    int ret_val = 0;
+    int *files = malloc((cmd->argc - i + 1) * sizeof(int));
+    int nFile = 0;
+    for ( ; i < cmd->argc; i++) {
+        int fd = open(cmd->argv[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", cmd->argv[i], strerror(errno));
+            ret_val = 1;
+            continue;
+        }
+        files[nFile++] = fd;
+    }
+
+    int r = copy_stream(s, files, nFile);
+    for (int j = 0; j < nFile; j++) {
+        if (files[j] >= 0) {
+            close(files[j]);
+        }
+    }
+    free(files);
+    return r ? r : ret_val;
+}
+
+
+static int thread_pipeline(const CMD *cmdList) {
+    int n = count_stages(cmdList);
+    Stage *stages = calloc(n, sizeof(Stage));
+    CMD **expanded = calloc(n, sizeof(CMD *));
+    Ring **rings = calloc(n, sizeof(Ring *));
+
+    // stages in order; expansion may fork, so it is done before any thread
+    for (int j = n - 1; j >= 0; j--) {
+        const CMD *stage = (cmdList->type == PIPE) ? cmdList->right : cmdList;
+        expanded[j] = expandCMD(stage);
+        stages[j].cmd = expanded[j] ? expanded[j] : stage;
+        cmdList = cmdList->left;
+    }
+
+    // ring j joins stage j to stage j+1
+    stages[0].in = (Stream) {NULL, STDIN_FILENO};
+    stages[n-1].out = (Stream) {NULL, STDOUT_FILENO};
+    for (int j = 0; j + 1 < n; j++) {
+        rings[j] = calloc(1, sizeof(Ring));
+        stages[j].out = (Stream) {rings[j], -1};
+        stages[j+1].in = (Stream) {rings[j], -1};
+    }
+
+    // dispositions belong to the process, so tee -i ignores SIGINT here for
+    // the life of the group rather than in its thread (the shell itself
+    // ignores it anyway; a child gets its own back afterwards)
+    bool ignore = false;
+    for (int j = 0; j < n; j++) {
+        ignore = ignore || ignores_interrupt(stages[j].cmd);
+    }
+    struct sigaction ign = {.sa_handler = SIG_IGN};
+    struct sigaction saved;
+    if (ignore) {
+        sigaction(SIGINT, &ign, &saved);
+    }
+
+    // the last stage runs in the calling thread
+    fflush(stdout);
+    int started = 0;
+    for ( ; started + 1 < n; started++) {
+        if (pthread_create(&stages[started].thread, NULL, run_stage, &stages[started]) != 0) {
+            perror("pthread_create() error");
+            break;
+        }
+    }
+    if (started + 1 == n) {
+        run_stage(&stages[n-1]);
+    }
+    else {
+        // behave as if the rest had failed to start
+        for (int j = started; j < n; j++) {
+            stages[j].status = 1;
+            if (stages[j].in.ring != NULL) {
+                atomic_store(&stages[j].in.ring->closed_r, true);
+                ring_wake(stages[j].in.ring);
+            }
+        }
+    }
+    for (int j = 0; j < started; j++) {
+        pthread_join(stages[j].thread, NULL);
+    }
+    if (ignore) {
+        sigaction(SIGINT, &saved, NULL);
+    }
+
+    // status of the rightmost stage that failed
+    int ret_val = 0;
+    for (int j = 0; j < n; j++) {
+        if (stages[j].status != 0) {
+            ret_val = stages[j].status;
+        }
+        freeExpanded(expanded[j]);
+        free(rings[j]);
+    }
+    free(stages);
+    free(expanded);
+    free(rings);
+    return ret_val;
+}
@@ -0,0 +1,36 @@
+// threadpipe.h
+//
+// Pipelines of built-ins run as threads.  Two or more adjacent stages that
+// are simple commands
+//
+//   echo [-n] ARG...    pwd    :    cat [FILE]...    tee [-a] [-i] [FILE]...
+//
+// with no <, >, local variables, or descriptor redirections are run by
+// pipe_command() as threads of a single process, each connected to the next
+// by a single-producer/single-consumer ring buffer in memory rather than a
+// kernel pipe.  Only the first stage of such a group reads the process's
+// stdin and only the last writes its stdout, so kernel pipes remain only at
+// the boundaries with other commands.  A group that makes up a whole
+// pipeline runs in the shell itself unless its first stage reads stdin or
+// the shell has job control (so that ^Z stops it).  tee -i makes the
+// process running the group ignore SIGINT until the group finishes.
+//
+// Statuses combine as for separate processes (that of the rightmost stage
+// that failed).  A stage whose reader has finished and whose ring is full
+// stops with status 141, as if killed by SIGPIPE.
+//
+// Set PIPE_NOTHREADS to fork every stage as before; PIPEPROF also does.
+
+#include "process.h"
+
+// Return the number of stages at the right end of the pipeline CMDLIST that
+// can run as threads, or 0 if fewer than two (or threads are disabled)
+int thread_suffix (const CMD *cmdList);
+
+// Run the pipeline CMDLIST, whose stages can all run as threads, and return
+// its status
+int thread_command (const CMD *cmdList);
+
+// Return a malloc()-ed pipeline equivalent to CMDLIST, whose right child is
+// a pipeline of the last K stages of CMDLIST; free() it when done
+CMD *thread_regroup (const CMD *cmdList, int k);
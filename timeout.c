@@ -0,0 +1,119 @@
+#include "timeout.h"
+#include "jobs.h"
+
+// signals that may be given by name
+static const struct {
+    const char *name;
+    int sig;
+} signals[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE},
+    {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CONT", SIGCONT},
+    {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}
+};
+
+
+// FUNCTION DECLARATIONS
+// store in *ns the duration s (e.g. "1.5", "2m"); return false if malformed
+static bool parse_duration(const char *s, long *ns);
+// return the signal named or numbered s, or -1
+static int parse_signal(const char *s);
+
+
+static bool parse_duration(const char *s, long *ns) {
+    char *end;
+    errno = 0;
+    double secs = strtod(s, &end);
+    if (end == s || errno != 0 || secs < 0) {
+        return false;
+    }
+    if (*end == 'm') {
+        secs *= 60;
+        end++;
+    }
+    else if (*end == 'h') {
+        secs *= 60 * 60;
+        end++;
+    }
+    else if (*end == 'd') {
+        secs *= 24 * 60 * 60;
+        end++;
+    }
+    else if (*end == 's') {
+        end++;
+    }
+    if (*end != '\0' || secs > LONG_MAX / 1e9) {
+        return false;
+    }
+    *ns = (long) (secs * 1e9);
+    return true;
+}
+
+
+static int parse_signal(const char *s) {
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (end != s && *end == '\0') {
+        return (n > 0 && n < NSIG) ? n : -1;
+    }
+    if (strncmp(s, "SIG", 3) == 0) {
+        s += 3;
+    }
+    for (int i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+        if (strcmp(s, signals[i].name) == 0) {
+            return signals[i].sig;
+        }
+    }
+    return -1;
+}
+
+
+int timeout_command(const CMD *cmdList) {
+    int sig = SIGTERM;
+    long ns = -1;
+    long kill_ns = 0;
+
+    int i = 1;
+    for ( ; i < cmdList->argc; i++) {
+        const char *arg = cmdList->argv[i];
+        if (strcmp(arg, "-s") == 0 && i + 1 < cmdList->argc) {
+            if ((sig = parse_signal(cmdList->argv[++i])) < 0) {
+                fprintf(stderr, "timeout: %s: invalid signal\n", cmdList->argv[i]);
+                return 125;
+            }
+        }
+        else if (strcmp(arg, "-k") == 0 && i + 1 < cmdList->argc) {
+            if (!parse_duration(cmdList->argv[++i], &kill_ns)) {
+                fprintf(stderr, "timeout: %s: invalid duration\n", cmdList->argv[i]);
+                return 125;
+            }
+        }
+        else if (ns < 0) {
+            if (!parse_duration(arg, &ns)) {
+                fprintf(stderr, "timeout: %s: invalid duration\n", arg);
+                return 125;
+            }
+        }
+        else {
+            break;
+        }
+    }
+    if (ns < 0 || i >= cmdList->argc) {
+        fprintf(stderr, "usage: timeout [-s SIG] [-k KILLAFTER] DURATION command [arg]...\n");
+        return 125;
+    }
+
+    // the copy keeps N>FILE etc., applied in the child (see fdRedirs())
+    CMD sub = *cmdList;
+    sub.argv = cmdList->argv + i;
+    sub.argc = cmdList->argc - i;
+    job_deadline(ns, sig, kill_ns);
+    int ret_val = simple_command(&sub);
+    int expired = job_expired();
+    job_deadline(0, 0, 0);
+
+    if (expired == 2) {
+        return 128 + SIGKILL;
+    }
+    return expired ? 124 : ret_val;
+}
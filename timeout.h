@@ -0,0 +1,17 @@
+// timeout.h
+//
+// Built-in "timeout [-s SIG] [-k KILLAFTER] DURATION command [arg]..."
+// (options may also follow DURATION) runs COMMAND as any simple command,
+// forked by the shell, with a deadline on its waits (see job_deadline() in
+// jobs.h).  When DURATION expires, SIG (default TERM) is sent to the
+// command's process group, and, if KILLAFTER is given, SIGKILL that much
+// later.  Durations are decimal numbers of seconds, or of minutes, hours, or
+// days with a suffix of m, h, or d; 0 means no limit.
+//
+// Status: 124 if the command timed out (137 if SIGKILL was sent), 125 if
+// the arguments are invalid, otherwise that of the command.
+
+#include "process.h"
+
+// Built-in timeout; return status
+int timeout_command (const CMD *cmdList);
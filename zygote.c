@@ -0,0 +1,374 @@
+#include "zygote.h"
+#include "jobs.h"
+#include "shellstat.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+// largest request the helper accepts; bigger commands are forked directly
+#define ZYGOTE_MAXMSG (1 << 20)
+
+
+// request header; followed by cwd, argv[], and envp[] as NUL-terminated
+// strings, with stdin, stdout, and stderr attached as SCM_RIGHTS
+typedef struct request {
+    int argc;
+    int envc;
+    int pgid;           // process group to join
+    cpu_set_t cpus;     // CPUs the command may run on
+} Request;
+
+// reply sent once the command has exited
+typedef struct reply {
+    int pid;
+    int status;         // as returned by waitpid(), or stopped
+} Reply;
+
+static int zsock = -1;          // shell's end of the socketpair
+static pid_t zowner = 0;        // process that started the helper
+
+
+// FUNCTION DECLARATIONS
+// helper main loop; never returns
+static void zygote_loop(int sock);
+// open the descriptor for stdin (which = 0) or stdout (which = 1) of cmdList
+static int open_redirect(const CMD *cmdList, int which);
+
+
+int zygote_start(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, sv) < 0) {
+        int errno2 = errno;
+        perror("socketpair() error");
+        return errno2;
+    }
+    int size = ZYGOTE_MAXMSG;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    stat_add(ST_FORKS, 1);
+    int pid = fork();
+    if (pid < 0) {
+        int errno2 = errno;
+        perror("Fork failure");
+        close(sv[0]);
+        close(sv[1]);
+        return errno2;
+    }
+
+    // helper
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_loop(sv[1]);
+    }
+
+    close(sv[1]);
+    zsock = sv[0];
+    zowner = getpid();
+    return 0;
+}
+
+
+bool zygote_active(void) {
+    // children of the shell (pipeline stages, subshells) fork for themselves,
+    // and under job control so does the shell: a command stopped by ^Z must
+    // be its child for "fg" and "bg" to wait for it
+    return zsock >= 0 && getpid() == zowner && !job_control();
+}
+
+
+int zygote_spawn(const CMD *cmdList) {
+    // serialize cwd, argv, and environment with local variables applied
+    char *cwd = get_current_dir_name();
+    if (cwd == NULL) {
+        return -1;
+    }
+
+    size_t len = sizeof(Request) + strlen(cwd) + 1;
+    Request req = {cmdList->argc, 0, getpgrp()};
+    // the helper was forked at startup; the command gets the mask the shell
+    // has now (e.g. inside taskset)
+    if (sched_getaffinity(0, sizeof(req.cpus), &req.cpus) < 0) {
+        free(cwd);
+        return -1;
+    }
+    for (int i = 0; i < cmdList->argc; i++) {
+        len += strlen(cmdList->argv[i]) + 1;
+    }
+    for (char **e = environ; *e; e++) {
+        len += strlen(*e) + 1;
+        req.envc++;
+    }
+    for (int i = 0; i < cmdList->nLocal; i++) {
+        len += strlen(cmdList->locVar[i]) + strlen(cmdList->locVal[i]) + 2;
+        req.envc++;
+    }
+    if (len > ZYGOTE_MAXMSG) {
+        free(cwd);
+        return -1;
+    }
+
+    char *msg = malloc(len);
+    char *p = msg + sizeof(Request);
+    p = stpcpy(p, cwd) + 1;
+    free(cwd);
+    for (int i = 0; i < cmdList->argc; i++) {
+        p = stpcpy(p, cmdList->argv[i]) + 1;
+    }
+    for (char **e = environ; *e; e++) {
+        // skip variables overridden by locals
+        bool local = false;
+        for (int i = 0; i < cmdList->nLocal && !local; i++) {
+            size_t n = strlen(cmdList->locVar[i]);
+            local = strncmp(*e, cmdList->locVar[i], n) == 0 && (*e)[n] == '=';
+        }
+        if (local) {
+            req.envc--;
+            continue;
+        }
+        p = stpcpy(p, *e) + 1;
+    }
+    for (int i = 0; i < cmdList->nLocal; i++) {
+        p = stpcpy(p, cmdList->locVar[i]);
+        *p++ = '=';
+        p = stpcpy(p, cmdList->locVal[i]) + 1;
+    }
+    memcpy(msg, &req, sizeof(req));
+    len = p - msg;
+
+    // redirections are opened by the shell and passed along
+    int fds[3];
+    fds[0] = open_redirect(cmdList, 0);
+    if (fds[0] < 0) {
+        free(msg);
+        return errno;
+    }
+    fds[1] = open_redirect(cmdList, 1);
+    if (fds[1] < 0) {
+        int errno2 = errno;
+        if (fds[0] != STDIN_FILENO) {
+            close(fds[0]);
+        }
+        free(msg);
+        return errno2;
+    }
+    fds[2] = STDERR_FILENO;
+
+    struct iovec iov = {msg, len};
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr mh = {0};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    ssize_t s = sendmsg(zsock, &mh, MSG_NOSIGNAL);
+    free(msg);
+    if (fds[0] != STDIN_FILENO) {
+        close(fds[0]);
+    }
+    if (fds[1] != STDOUT_FILENO) {
+        close(fds[1]);
+    }
+    if (s < 0) {
+        // helper gone: stop using it
+        if (errno != EMSGSIZE) {
+            close(zsock);
+            zsock = -1;
+        }
+        return -1;
+    }
+
+    // the shell ignores CTRL-C throughout (see jobs.h)
+    Reply rep;
+    ssize_t r;
+    while ((r = recv(zsock, &rep, sizeof(rep), 0)) < 0 && errno == EINTR)
+        ;
+
+    if (r != sizeof(rep)) {
+        fprintf(stderr, "zygote: helper exited\n");
+        close(zsock);
+        zsock = -1;
+        return 1;
+    }
+
+    // a stopped command is left to whoever continues it, as job_wait() does
+    if (WIFSTOPPED(rep.status)) {
+        fprintf(stderr, "\n%d  Stopped\t\t%s\n", rep.pid, cmdList->argv[0]);
+        return 128 + WSTOPSIG(rep.status);
+    }
+    return STATUS(rep.status);
+}
+
+
+static int open_redirect(const CMD *cmdList, int which) {
+    if (which == 0) {
+        switch (cmdList->fromType) {
+            // '<'
+            case RED_IN:
+            {
+                int fd = open(cmdList->fromFile, O_RDONLY|O_CLOEXEC);
+                if (fd < 0) {
+                    perror("Open error");
+                    return fd;
+                }
+                stat_add(ST_REDIRS, 1);
+                return fd;
+            }
+
+            // '<<': contents live in an anonymous file, not in the cwd
+            case RED_IN_HERE:
+            {
+                int fd = memfd_create("here", MFD_CLOEXEC);
+                if (fd < 0) {
+                    perror("memfd_create() error");
+                    return fd;
+                }
+                stat_add(ST_HEREDOCS, 1);
+                size_t n = strlen(cmdList->fromFile);
+                if (write(fd, cmdList->fromFile, n) != (ssize_t) n) {
+                    perror("Write error");
+                    close(fd);
+                    return -1;
+                }
+                lseek(fd, 0, SEEK_SET);
+                return fd;
+            }
+
+            default:
+                return STDIN_FILENO;
+        }
+    }
+
+    int flags;
+    switch (cmdList->toType) {
+        // '>'
+        case RED_OUT:
+            flags = O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC;
+            break;
+
+        // '>>'
+        case RED_OUT_APP:
+            flags = O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC;
+            break;
+
+        default:
+            return STDOUT_FILENO;
+    }
+    int fd = open(cmdList->toFile, flags, S_IRWXU);
+    if (fd < 0) {
+        perror("Open error");
+        return fd;
+    }
+    stat_add(ST_REDIRS, 1);
+    return fd;
+}
+
+
+static void zygote_loop(int sock) {
+    // CTRL-C is for the command, not the helper
+    signal(SIGINT, SIG_IGN);
+
+    char *msg = malloc(ZYGOTE_MAXMSG);
+    for ( ; ; ) {
+        int fds[3];
+        union {
+            char buf[CMSG_SPACE(sizeof(fds))];
+            struct cmsghdr align;
+        } control;
+        struct iovec iov = {msg, ZYGOTE_MAXMSG};
+        struct msghdr mh = {0};
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control.buf;
+        mh.msg_controllen = sizeof(control.buf);
+
+        // reap commands that stopped, were continued, and have since exited
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+            ;
+
+        ssize_t n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // shell exited
+        if (n <= 0) {
+            _exit(0);
+        }
+
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        if (cm == NULL || cm->cmsg_type != SCM_RIGHTS || (size_t) n < sizeof(Request)) {
+            continue;
+        }
+        memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+
+        // unpack cwd, argv, and envp in place
+        Request req;
+        memcpy(&req, msg, sizeof(req));
+        char *p = msg + sizeof(Request);
+        char *cwd = p;
+        p += strlen(p) + 1;
+        char **argv = malloc((req.argc + 1) * sizeof(char *));
+        for (int i = 0; i < req.argc; i++) {
+            argv[i] = p;
+            p += strlen(p) + 1;
+        }
+        argv[req.argc] = NULL;
+        char **envp = malloc((req.envc + 1) * sizeof(char *));
+        for (int i = 0; i < req.envc; i++) {
+            envp[i] = p;
+            p += strlen(p) + 1;
+        }
+        envp[req.envc] = NULL;
+
+        stat_add(ST_FORKS, 1);
+        Reply rep = {fork(), 0};
+        if (rep.pid == 0) {
+            signal(SIGINT, SIG_DFL);
+            setpgid(0, req.pgid);
+            if (sched_setaffinity(0, sizeof(req.cpus), &req.cpus) < 0) {
+                perror("sched_setaffinity() error");
+            }
+            if (chdir(cwd) < 0) {
+                perror("chdir() error");
+            }
+            for (int i = 0; i < 3; i++) {
+                dup2(fds[i], i);
+            }
+            // execvp() searches the PATH in environ
+            environ = envp;
+            stat_add(ST_EXECS, 1);
+            execvp(argv[0], argv);
+            int errno2 = errno;
+            stat_add(ST_EXEC_FAILS, 1);
+            perror("execvp() error");
+            exit(errno2);
+        }
+
+        for (int i = 0; i < 3; i++) {
+            close(fds[i]);
+        }
+        free(argv);
+        free(envp);
+
+        if (rep.pid < 0) {
+            rep.status = errno << 8;
+        }
+        else {
+            // report a stop rather than wait for the command to continue
+            while (waitpid(rep.pid, &rep.status, WUNTRACED) < 0 && errno == EINTR)
+                ;
+        }
+        send(sock, &rep, sizeof(rep), MSG_NOSIGNAL);
+    }
+}
@@ -0,0 +1,27 @@
+// zygote.h
+//
+// Optional zygote mode (enabled by setting ZYGOTE before the shell starts).
+// At startup the shell forks a small helper that stays alive for the whole
+// session.  simple_command() then sends it each spawn request -- argv, the
+// environment, the working directory, and the stdin/stdout/stderr
+// descriptors (passed with SCM_RIGHTS) -- over a Unix socketpair.  The
+// helper forks and execs from its own small address space and reports the
+// exit status back, so launch cost does not grow with the shell's heap.
+// The command joins the shell's process group and runs on the CPUs the
+// shell may use at the time (e.g. inside taskset).  If it stops, the stop
+// is reported and the shell goes on; it is reaped once it exits.
+//
+// Under job control the shell forks every command itself, since only its
+// own children can be resumed by "fg" and "bg".
+
+#include "process.h"
+
+// Start the helper; return 0 or errno
+int zygote_start (void);
+
+// Return true if this process may hand commands to the helper
+bool zygote_active (void);
+
+// Run the SIMPLE command CMDLIST through the helper and return its status,
+// or -1 if it could not be handed off (the caller should fork it itself)
+int zygote_spawn (const CMD *cmdList);